@@ -27,29 +27,29 @@ void ListPackage::ImportPackage(const Ref<Environment>& environment, const std::
 
 
 	DEFINE_AND_REGISTER(clear, 1, {
-		arguments[0]->as_list().clear();
+		arguments[0]->mutable_list().clear();
 		return nullptr;
 	});
 
 	DEFINE_AND_REGISTER(pop_back, 1, {
-		arguments[0]->as_list().pop_back();
+		arguments[0]->mutable_list().pop_back();
 		return nullptr;
 	});
 	DEFINE_AND_REGISTER(pop, 1, {
-		arguments[0]->as_list().pop_back();
+		arguments[0]->mutable_list().pop_back();
 		return nullptr;
 	});
 
 	DEFINE_AND_REGISTER(push_back, 2, {
-		arguments[0]->as_list().push_back(arguments[1]);
+		arguments[0]->mutable_list().push_back(arguments[1]);
 		return nullptr;
 	});
 	DEFINE_AND_REGISTER(push, 2, {
-		arguments[0]->as_list().push_back(arguments[1]);
+		arguments[0]->mutable_list().push_back(arguments[1]);
 		return nullptr;
 	});
 	DEFINE_AND_REGISTER(append, 2, {
-		arguments[0]->as_list().push_back(arguments[1]);
+		arguments[0]->mutable_list().push_back(arguments[1]);
 		return nullptr;
 	});
 
@@ -75,7 +75,7 @@ void ListPackage::ImportPackage(const Ref<Environment>& environment, const std::
 		return new_object;
 	});
 
-	environment->predefine(Token(IDENTIFIER, ns->name, {}, 0), CreateRef<Object>(ns));
+	environment->predefine(Token(IDENTIFIER, ns->name, 0), CreateRef<Object>(ns));
 }
 
 
@@ -53,7 +53,7 @@ void MathPackage::ImportPackage(const Ref<Environment>& environment, const std::
 
 	m["PI"] = CreateRef<Object>(Math_PI);
 
-	environment->predefine(Token(IDENTIFIER, ns->name, {}, 0), CreateRef<Object>(ns));
+	environment->predefine(Token(IDENTIFIER, ns->name, 0), CreateRef<Object>(ns));
 }
 
 
@@ -26,11 +26,11 @@ Color get_color_from_arg(const Ref<Object>& argument) {
 	Color color = Color{0, 0, 0, 255};
 	if (argument->is_instance()) {
 		Ref<MinikInstance> cal = argument->as_instance();
-		NativeClass &nc = cal->nclas;
-		color.r = find_field(nc.fields, "r")->as_double(); 
-		color.g = find_field(nc.fields, "g")->as_double(); 
-		color.b = find_field(nc.fields, "b")->as_double(); 
-		color.a = find_field(nc.fields, "a")->as_double(); 
+		const FieldsMap& fields = *cal->native_fields;
+		color.r = find_field(fields, "r")->as_double(); 
+		color.g = find_field(fields, "g")->as_double(); 
+		color.b = find_field(fields, "b")->as_double(); 
+		color.a = find_field(fields, "a")->as_double(); 
 	}
 	return color;
 }
@@ -41,7 +41,7 @@ void define_and_register_functions(FieldsMap& m) {
 DEFINE_AND_REGISTER(InitWindow, 3, {
 	int width =  arguments[0]->as_double();
 	int height = arguments[1]->as_double();
-	std::string& title = arguments[2]->as_string();
+	const std::string& title = arguments[2]->as_string();
 
 	SetConfigFlags(FLAG_WINDOW_RESIZABLE);
 	InitWindow(width, height, title.c_str());
@@ -200,7 +200,7 @@ void RaylibPackage::ImportPackage(const Ref<Environment>& environment, const std
 
 	// NOTE: this is global, can be accessed like: 
 	// v := Vector2(1,2);
-	// environment->predefine(Token{CLASS,"Vector2",nullptr,0}, CreateRef<Object>(vector2));
+	// environment->predefine(Token{CLASS,"Vector2",0}, CreateRef<Object>(vector2));
 
 
 	Ref<NativeClass> col = CreateColor(1,1,1,1);
@@ -209,7 +209,7 @@ void RaylibPackage::ImportPackage(const Ref<Environment>& environment, const std
 
 	define_KEYs(ns->fields);
 
-	environment->predefine(Token(IDENTIFIER, ns->name, {}, 0), CreateRef<Object>(ns));
+	environment->predefine(Token(IDENTIFIER, ns->name, 0), CreateRef<Object>(ns));
 }
 
 
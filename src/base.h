@@ -17,9 +17,11 @@
 #endif
 
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <cstdarg>
+#include <type_traits>
 #include "log.h"
 
 
@@ -33,12 +35,122 @@ constexpr Scope<T> CreateScope(Args&& ... args) {
 	return std::make_unique<T>(std::forward<Args>(args)...);
 }
 
+// intrusive reference count, objects held by a Ref derive from one of these.
+// The interpreter is single threaded so the count is a plain integer,
+// AtomicRefCounted is for objects shared between threads.
+// Copying an object doesn't copy its count.
+class RefCounted {
+public:
+	RefCounted() = default;
+	RefCounted(const RefCounted&) {}
+	RefCounted& operator=(const RefCounted&) { return *this; }
+
+	void add_ref() const { ++m_ref_count; }
+	// true when the last reference is gone
+	bool release_ref() const { return --m_ref_count == 0; }
+	uint32_t ref_count() const { return m_ref_count; }
+
+private:
+	mutable uint32_t m_ref_count = 0;
+};
+
+class AtomicRefCounted {
+public:
+	AtomicRefCounted() = default;
+	AtomicRefCounted(const AtomicRefCounted&) {}
+	AtomicRefCounted& operator=(const AtomicRefCounted&) { return *this; }
+
+	void add_ref() const { m_ref_count.fetch_add(1, std::memory_order_relaxed); }
+	bool release_ref() const { return m_ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+	uint32_t ref_count() const { return m_ref_count.load(std::memory_order_relaxed); }
+
+private:
+	mutable std::atomic<uint32_t> m_ref_count = 0;
+};
+
+// shared handle to a RefCounted object, one pointer wide
 template<typename T>
-using Ref = std::shared_ptr<T>;
+class Ref {
+public:
+	Ref() = default;
+	Ref(std::nullptr_t) {}
+	explicit Ref(T* ptr) : m_ptr(ptr) { add_ref(); }
+
+	Ref(const Ref& other) : m_ptr(other.m_ptr) { add_ref(); }
+	Ref(Ref&& other) noexcept : m_ptr(other.m_ptr) { other.m_ptr = nullptr; }
+	template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+	Ref(const Ref<U>& other) : m_ptr(other.m_ptr) { add_ref(); }
+	template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+	Ref(Ref<U>&& other) noexcept : m_ptr(other.m_ptr) { other.m_ptr = nullptr; }
+
+	~Ref() { release(); }
+
+	// the old object is released last, other may live inside it (node = node->next)
+	Ref& operator=(const Ref& other) {
+		Ref(other).swap(*this);
+		return *this;
+	}
+	Ref& operator=(Ref&& other) noexcept {
+		Ref(std::move(other)).swap(*this);
+		return *this;
+	}
+	Ref& operator=(std::nullptr_t) {
+		reset();
+		return *this;
+	}
+
+	void reset() {
+		Ref().swap(*this);
+	}
+
+	void swap(Ref& other) noexcept {
+		T* ptr = m_ptr;
+		m_ptr = other.m_ptr;
+		other.m_ptr = ptr;
+	}
+
+	T* get() const { return m_ptr; }
+	T& operator*() const { return *m_ptr; }
+	T* operator->() const { return m_ptr; }
+	explicit operator bool() const { return m_ptr != nullptr; }
+	uint32_t use_count() const { return m_ptr ? m_ptr->ref_count() : 0; }
+
+private:
+	void add_ref() const {
+		if (m_ptr) {
+			m_ptr->add_ref();
+		}
+	}
+	void release() {
+		if (m_ptr && m_ptr->release_ref()) {
+			delete m_ptr;
+		}
+	}
+
+	template<typename U>
+	friend class Ref;
+
+private:
+	T* m_ptr = nullptr;
+};
+
+template<typename T, typename U>
+bool operator==(const Ref<T>& a, const Ref<U>& b) { return a.get() == b.get(); }
+template<typename T, typename U>
+bool operator!=(const Ref<T>& a, const Ref<U>& b) { return a.get() != b.get(); }
+template<typename T>
+bool operator==(const Ref<T>& a, std::nullptr_t) { return !a; }
+template<typename T>
+bool operator!=(const Ref<T>& a, std::nullptr_t) { return (bool)a; }
 
 template<typename T, typename ... Args>
-constexpr Ref<T> CreateRef(Args&& ... args) {
-	return std::make_shared<T>(std::forward<Args>(args)...);
+Ref<T> CreateRef(Args&& ... args) {
+	return Ref<T>(new T(std::forward<Args>(args)...));
+}
+
+template<typename T, typename U>
+Ref<T> DynamicRefCast(const Ref<U>& ref) {
+	return Ref<T>(dynamic_cast<T*>(ref.get()));
 }
 
 }
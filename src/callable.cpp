@@ -6,11 +6,17 @@
 #include "minik.h"
 #include "object.h"
 #include "token.h"
+#include <atomic>
 #include <chrono>
 #include <cmath>
 
 namespace minik {
 
+uint64_t MinikCallable::next_id() {
+	static std::atomic<uint64_t> s_next_id = 1;
+	return s_next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
 Ref<Object> MinikCallable::call(Interpreter& interpreter, const Arguments& arguments) {
 	return CreateRef<Object>(404.404);
 }
@@ -20,7 +26,7 @@ Ref<Object> mcClock::call(Interpreter& interpreter, const Arguments& arguments)
 }
 
 Ref<Object> mcAssert::call(Interpreter& interpreter, const Arguments& arguments) {
-	Token error_token = Token{IDENTIFIER, "assert", {}, 0};
+	Token error_token = Token{IDENTIFIER, "assert", 0};
 	if (arguments.size() == 0) {
 		throw InterpreterException(error_token, "assert expects at least one argument.");
 	}
@@ -60,7 +66,7 @@ Ref<Object> mcToString::call(Interpreter& interpreter, const Arguments& argument
 }
 
 Ref<Object> mcPrint::call(Interpreter& interpreter, const Arguments& arguments) {
-	Token error_token = Token{IDENTIFIER, "print", {}, 0};
+	Token error_token = Token{IDENTIFIER, "print", 0};
 	if (arguments.size() == 0) {
 		throw InterpreterException(error_token, error_token.lexeme + " expects at least one argument.");
 	}
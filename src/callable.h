@@ -1,6 +1,8 @@
 #pragma once
 
 #include "base.h"
+#include "gc.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 namespace minik {
@@ -12,14 +14,28 @@ class MinikInstance;
 
 using Arguments = std::vector<Ref<Object>>;
 
-class MinikCallable {
+class MinikCallable : public CollectableRoot {
 public:
+	MinikCallable() : CollectableRoot(GCKind::CALLABLE), m_id(next_id()) {}
+	MinikCallable(const MinikCallable& other) : CollectableRoot(other), instance(other.instance), m_id(next_id()) {}
 	virtual ~MinikCallable() = default;
 	virtual Ref<Object> call(Interpreter& interpreter, const Arguments& arguments);
 	virtual int arity() { return 0; }
 	virtual std::string to_string() const { return "<fn>"; }
 
+	// references the cycle collector follows, and drops to break a garbage cycle
+	virtual void trace(GCTracer& tracer) const {}
+	virtual void clear_references() {}
+
+	// never reused, a call site caches it instead of a reference to the callable
+	uint64_t id() const { return m_id; }
+
 	MinikInstance* instance = nullptr;
+
+private:
+	static uint64_t next_id();
+
+	uint64_t m_id;
 };
 
 class mcClock : public MinikCallable {
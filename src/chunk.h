@@ -0,0 +1,105 @@
+#pragma once
+
+#include "base.h"
+#include "object.h"
+#include "value.h"
+#include "token.h"
+#include <cstdint>
+#include <vector>
+
+namespace minik {
+
+class MinikFunction;
+struct Chunk;
+
+enum class OpCode : uint8_t {
+	CONSTANT, NIL, NONE, TRUE, FALSE, POP,
+
+	GET_LOCAL,    SET_LOCAL,    INC_LOCAL,
+	GET_CAPTURE,  SET_CAPTURE,  INC_CAPTURE,
+	GET_UPPER,    SET_UPPER,    INC_UPPER,
+	GET_GLOBAL,   SET_GLOBAL,   INC_GLOBAL,
+	GET_PROPERTY, SET_PROPERTY, INC_PROPERTY,
+	GET_INDEX,    SET_INDEX,    INC_INDEX,
+	INC_VALUE,
+
+	ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO,
+	EQUAL, NOT_EQUAL, GREATER, GREATER_EQUAL, LESS, LESS_EQUAL,
+	NOT, NEGATE,
+
+	JUMP, JUMP_IF_FALSE, JUMP_IF_TRUE_KEEP, JUMP_IF_FALSE_KEEP,
+
+	CALL, INVOKE, RETURN,
+	LIST, LIST_SIZED
+};
+
+// flags of GET_CAPTURE/GET_UPPER/GET_GLOBAL
+static constexpr uint8_t OP_FLAG_NAMESPACE = 1 << 0;
+// flag of CONSTANT and SET_LOCAL, pushes or stores a copy of the object
+static constexpr uint8_t OP_FLAG_COPY = 1 << 1;
+// flags of SET_INDEX, where a changed string is stored back to: the variable stored by
+// the next instruction (skipped when no string changed), the field named by the operand
+// or the element at the key below the index
+static constexpr uint8_t OP_FLAG_STORE   = 1 << 2;
+static constexpr uint8_t OP_FLAG_FIELD   = 1 << 3;
+static constexpr uint8_t OP_FLAG_ELEMENT = 1 << 4;
+
+
+struct Instruction {
+	OpCode op;
+	uint8_t flags = 0;
+	uint16_t depth = 0;
+	int32_t operand = 0;
+	int32_t token = -1;
+};
+
+// slot of the global table assigned by the resolver
+struct GlobalCache {
+	int32_t name;
+	int32_t index;
+};
+
+// variable of an enclosing function that isn't captured, or of the scopes around a loop
+// the tree walker runs on the vm, looked up in the closure by slot, or by name if it has none.
+// Every function running the chunk caches the cell it finds, see MinikFunction::m_uppers
+struct Upper {
+	int32_t name;
+	int32_t slot;
+	uint16_t depth;
+};
+
+// inline caches, filled by the vm on first use
+
+// the id of the last callee of a CALL, the callee as a function and the chunk it runs,
+// null when it is not compiled. Not references, the chunk would keep every callee alive
+struct CallCache {
+	mutable uint64_t callee = 0;
+	mutable MinikFunction* function = nullptr;
+	mutable const Chunk* chunk = nullptr;
+};
+
+// obj.name(), the method is called without binding it to the instance
+struct InvokeCache {
+	int32_t name;
+	FieldCache field = {};
+	MethodCache method = {};
+	CallCache call = {};
+};
+
+struct Chunk : public RefCounted {
+	std::vector<Instruction> code;
+	std::vector<Value> constants;
+	std::vector<Token> tokens;
+	std::vector<GlobalCache> globals;
+	std::vector<Upper> uppers;
+	std::vector<CallCache> calls;
+	std::vector<InvokeCache> invokes;
+	std::vector<FieldCache> fields;
+
+	uint32_t arity = 0;
+	uint32_t slot_count = 0;
+	uint32_t max_stack = 0;
+	std::string name;
+};
+
+}
@@ -6,43 +6,84 @@
 #include "token.h"
 #include "function.h"
 #include "interpreter.h"
+#include "statement.h"
 
 
 namespace minik {
 
 
+MinikClass::MinikClass(const std::string name, const MethodsMap& methods, const MembersMap& members, const Ref<Environment>& closure)
+	: name(name), methods(methods), members(members), m_closure(closure)
+{
+	if (m_closure) {
+		m_closure->keep_as_closure();
+	}
+	m_prototype.reserve(members.size());
+	for (const auto& member : members) {
+		const int slot = shape->slots.size();
+		shape->slots.emplace(member.first, slot);
+
+		const Ref<Expression>& initializer = member.second->initializer;
+		if (!initializer) {
+			m_prototype.push_back(Value::none());
+		} else if (initializer->kind == ExpressionKind::LITERAL) {
+			m_prototype.push_back(static_cast<LiteralExpression&>(*initializer).value->value);
+		} else {
+			m_prototype.push_back(Value::none());
+			m_computed.emplace_back(slot, member.second.get());
+		}
+	}
+	m_initializer = find_method(name);
+}
+
 Ref<Object> MinikClass::call(Interpreter& interpreter, const std::vector<Ref<Object>>& arguments) {
-	Ref<MinikInstance> instance = CreateRef<MinikInstance>(*this);
+	Ref<MinikInstance> instance = CreateRef<MinikInstance>(Ref<MinikClass>(this));
 
-	const Ref<Environment> previous = interpreter.m_environment;
-	interpreter.m_environment = m_closure;
+	std::vector<Ref<Object>>& fields = instance->fields;
+	for (size_t i = 0; i < m_prototype.size(); ++i) {
+		if (!m_prototype[i].is_none()) {
+			fields[i] = CreateRef<Object>(m_prototype[i].clone());
+		}
+	}
 
-	for (const auto& member : members) {
-		VariableStatement& vs = *member.second.get();
-		Ref<Object> value;
-		if (vs.initializer) {
-			value = interpreter.evaluate(vs.initializer);
+	if (!m_computed.empty()) {
+		const Ref<Environment> previous = interpreter.m_environment;
+		interpreter.m_environment = m_closure;
+		for (const auto& member : m_computed) {
+			fields[member.first] = interpreter.evaluate_cell(member.second->initializer);
 		}
-		instance->fields[member.first] = value;
+		interpreter.m_environment = previous;
 	}
-	interpreter.m_environment = previous;
 
-	Ref<MinikFunction> initializer = find_method(name);
-	if (initializer) {
-		initializer->bind(instance)->call(interpreter, arguments);
+	Ref<Object> self = CreateRef<Object>(instance);
+	if (m_initializer) {
+		m_initializer->invoke(interpreter, arguments, self);
 	}
-	
-	return CreateRef<Object>(instance);
+
+	return self;
 }
 int MinikClass::arity() {
-	Ref<MinikFunction> initializer = find_method(name);
-	if (initializer) {
-		return initializer->arity();
+	if (m_initializer) {
+		return m_initializer->arity();
 	}
 	return 0;
 }
 
 
+void MinikClass::trace(GCTracer& tracer) const {
+	tracer.visit(m_closure);
+	for (const auto& method : methods) {
+		tracer.visit(method.second);
+	}
+	tracer.visit(m_initializer);
+}
+
+void MinikClass::clear_references() {
+	m_closure = nullptr;
+	methods.clear();
+	m_initializer = nullptr;
+}
+
 Ref<MinikFunction> MinikClass::find_method(const std::string& name) {
 	auto itm = methods.find(name);
 	if (itm != methods.end()) {
@@ -51,33 +92,84 @@ Ref<MinikFunction> MinikClass::find_method(const std::string& name) {
 	return nullptr;
 }
 
-Ref<Object> MinikInstance::get(const Token& name, const Ref<MinikInstance>& self) {
-	auto it = fields.find(name.lexeme);
-	if (it != fields.end()) {
-		return it->second;
+void MinikInstance::trace(GCTracer& tracer) const {
+	tracer.visit(m_class);
+	for (const Ref<Object>& field : fields) {
+		tracer.visit(field);
 	}
+	if (native_fields) {
+		for (const auto& field : *native_fields) {
+			tracer.visit(field.second);
+		}
+	}
+}
 
-	if (!is_native) {
-		Ref<MinikFunction> fn = clas.find_method(name.lexeme);
+void MinikInstance::clear_references() {
+	m_class = nullptr;
+	fields.clear();
+	shape = nullptr;
+	native_fields = nullptr;
+}
+
+Ref<Object>* MinikInstance::find_field_slow(const std::string& name, const FieldCache& cache) {
+	if (is_native()) {
+		auto it = native_fields->find(name);
+		return it != native_fields->end() ? &it->second : nullptr;
+	}
+	const int slot = shape->find(name);
+	if (slot < 0) {
+		return nullptr;
+	}
+	cache.shape = clas().shape;
+	cache.slot = slot;
+	return &fields[slot];
+}
+
+Ref<MinikFunction> MinikInstance::find_method(const std::string& name, const FieldCache& field, const MethodCache& cache) {
+	if (is_native()) {
+		return nullptr;
+	}
+	if (shape == cache.shape.get()) {
+		return Ref<MinikFunction>(static_cast<MinikFunction*>(cache.method));
+	}
+	if (find_field(name, field)) {
+		return nullptr;
+	}
+	Ref<MinikFunction> method = clas().find_method(name);
+	if (method) {
+		cache.shape = clas().shape;
+		cache.method = method.get();
+	}
+	return method;
+}
+
+Ref<Object> MinikInstance::get(const Token& name, const Ref<MinikInstance>& self, const FieldCache& cache) {
+	if (Ref<Object>* field = find_field(name.lexeme, cache)) {
+		return *field;
+	}
+
+	if (!is_native()) {
+		Ref<MinikFunction> fn = clas().find_method(name.lexeme);
 		if (fn) {
 			return CreateRef<Object>(fn->bind(self));
 		}
 	} else {
-		MN_LOG("native get %s in %s", name.lexeme.c_str(), nclas.name.c_str());
-		Ref<MinikCallable> fn = nclas.find_method(name.lexeme);
+		MN_LOG("native get %s in %s", name.lexeme.c_str(), nclas().name.c_str());
+		Ref<MinikCallable> fn = nclas().find_method(name.lexeme);
 		if (fn) {
 			return CreateRef<Object>(fn);
 		}
 	}
 
-	throw InterpreterException(name, "Undefined property '"+name.lexeme+"' in '"+clas.name+"'.");
+	throw InterpreterException(name, "Undefined property '"+name.lexeme+"' in '"+(is_native() ? nclas().name : clas().name)+"'.");
 }
 
-void MinikInstance::set(const Token& name, const Ref<Object>& value) {
-	if (fields.count(name.lexeme) == 0) {
+void MinikInstance::set(const Token& name, const Ref<Object>& value, const FieldCache& cache) {
+	Ref<Object>* field = find_field(name.lexeme, cache);
+	if (!field) {
 		throw InterpreterException(name, "Couldn't find field '"+name.lexeme+"' in instance.");
 	}
-	fields[name.lexeme] = value;
+	*field = value;
 }
 
 
@@ -96,23 +188,30 @@ Ref<Object> MinikNamespace::get(const Token& name) {
 	return nullptr;
 }
 
+void MinikNamespace::trace(GCTracer& tracer) const {
+	for (const auto& field : fields) {
+		tracer.visit(field.second);
+	}
+	tracer.visit(parent);
+}
 
+void MinikNamespace::clear_references() {
+	fields.clear();
+	parent = nullptr;
+}
 
 
 
-Ref<Object> NativeClass::call(Interpreter& interpreter, const Arguments& arguments) {
-	Ref<MinikInstance> instance = CreateRef<MinikInstance>(*this);
 
-	for (const auto& field : fields) {
-		instance->fields[field.first] = field.second;
-	}
 
+Ref<Object> NativeClass::call(Interpreter& interpreter, const Arguments& arguments) {
+	Ref<MinikInstance> instance = CreateRef<MinikInstance>(Ref<NativeClass>(this));
 	Ref<Object> result;
 
 	Ref<MinikCallable> initializer = find_method(name);
 	if (initializer) {
 		if (MinikFunction* f = dynamic_cast<MinikFunction*>(initializer.get())) {
-			result = f->bind(instance)->call(interpreter, arguments);
+			result = f->invoke(interpreter, arguments, CreateRef<Object>(instance));
 		} else {
 			result = initializer->call(interpreter, arguments);
 		}
@@ -122,6 +221,16 @@ Ref<Object> NativeClass::call(Interpreter& interpreter, const Arguments& argumen
 	
 	return result;
 }
+void NativeClass::trace(GCTracer& tracer) const {
+	for (const auto& field : fields) {
+		tracer.visit(field.second);
+	}
+}
+
+void NativeClass::clear_references() {
+	fields.clear();
+}
+
 Ref<MinikCallable> NativeClass::find_method(const std::string& name) {
 	auto it = fields.find(name);
 	if (it != fields.end()) {
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "callable.h"
+#include "pool.h"
+#include "value.h"
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace minik {
 
@@ -14,11 +17,35 @@ using CallablesMap = std::unordered_map<std::string, Ref<MinikCallable>>;
 using MembersMap = std::unordered_map<std::string, Ref<VariableStatement>>;
 using FieldsMap = std::unordered_map<std::string, Ref<Object>>;
 
+// field layout shared by the instances of a class, they keep their fields in an array
+struct Shape : public RefCounted {
+	std::unordered_map<std::string, int> slots = {};
+
+	int find(const std::string& name) const {
+		auto it = slots.find(name);
+		return it != slots.end() ? it->second : -1;
+	}
+};
+
+// inline cache of a field access, the last shape seen and the slot of the field in it
+struct FieldCache {
+	mutable Ref<Shape> shape = nullptr;
+	mutable int slot = -1;
+};
+
+// inline cache of a method call, the last shape seen and the method of its class
+struct MethodCache {
+	mutable Ref<Shape> shape = nullptr;
+	// a MinikFunction, held as a callable so the cache doesn't need its definition.
+	// Not a reference, the method's body would keep it alive. An instance of the shape
+	// keeps its class alive and the class its methods
+	mutable MinikCallable* method = nullptr;
+};
+
 
 class MinikClass : public MinikCallable {
 public:
-	MinikClass(const std::string name, const MethodsMap& methods, const MembersMap& members, const Ref<Environment>& closure)
-		: name(name), methods(methods), members(members), m_closure(closure) {}
+	MinikClass(const std::string name, const MethodsMap& methods, const MembersMap& members, const Ref<Environment>& closure);
 
 	virtual Ref<Object> call(Interpreter& interpreter, const std::vector<Ref<Object>>& arguments) override;
 	virtual int arity() override;
@@ -26,11 +53,22 @@ public:
 
 	Ref<MinikFunction> find_method(const std::string& name);
 
+	virtual void trace(GCTracer& tracer) const override;
+	virtual void clear_references() override;
+
 public:
 	const std::string name;
 	MethodsMap methods;
 	MembersMap members;
+	Ref<Shape> shape = CreateRef<Shape>();
 	Ref<Environment> m_closure;
+
+private:
+	// constructor plan, built once: the fields with a literal or no initializer are
+	// copied from the prototype, only the other initializers are evaluated per instance
+	std::vector<Value> m_prototype;
+	std::vector<std::pair<int, const VariableStatement*>> m_computed;
+	Ref<MinikFunction> m_initializer;
 };
 
 
@@ -49,38 +87,68 @@ public:
 	virtual Ref<Object> call(Interpreter& interpreter, const Arguments& arguments) override;
 	virtual std::string to_string() const override { return "<native class " + name + ">"; }
 
+	virtual void trace(GCTracer& tracer) const override;
+	virtual void clear_references() override;
+
 public:
 	const std::string name;
 	FieldsMap fields;
 };
 
 
-class MinikInstance {
+// an instance keeps a reference to its class and its own fields
+class MinikInstance : public CollectableRoot, public Pooled<PoolType::INSTANCE> {
 public:
-	MinikInstance(const MinikClass& clas) : clas(clas), nclas(""), is_native(false) {}
-	MinikInstance(const NativeClass& nclas) : clas({"",{},{},nullptr}), nclas(nclas), is_native(true) {}
+	MinikInstance(const Ref<MinikClass>& clas)
+		: CollectableRoot(GCKind::INSTANCE), m_class(clas), shape(clas->shape.get()), fields(clas->shape->slots.size()) {}
+	MinikInstance(const Ref<NativeClass>& nclas)
+		: CollectableRoot(GCKind::INSTANCE), m_class(nclas), native_fields(CreateScope<FieldsMap>(nclas->fields)) {}
+
+	Ref<Object> get(const Token& name, const Ref<MinikInstance>& self, const FieldCache& cache = {});
+	void set(const Token& name, const Ref<Object>& value, const FieldCache& cache = {});
+
+	// cell of a field, null if the instance has no field with that name
+	Ref<Object>* find_field(const std::string& name, const FieldCache& cache) {
+		if (shape && shape == cache.shape.get()) {
+			return &fields[cache.slot];
+		}
+		return find_field_slow(name, cache);
+	}
+	// method called by obj.name(), null when name is a field or not a method
+	Ref<MinikFunction> find_method(const std::string& name, const FieldCache& field, const MethodCache& cache);
 
-	Ref<Object> get(const Token& name, const Ref<MinikInstance>& self);
-	void set(const Token& name, const Ref<Object>& value);
+	void trace(GCTracer& tracer) const;
+	void clear_references();
 
+	bool is_native() const { return native_fields != nullptr; }
+	MinikClass& clas() const { return static_cast<MinikClass&>(*m_class); }
+	NativeClass& nclas() const { return static_cast<NativeClass&>(*m_class); }
 
-	std::string to_string() const { return "<instance of " + (is_native ? nclas.name : clas.name) + ">"; }
+	std::string to_string() const { return "<instance of " + (is_native() ? nclas().name : clas().name) + ">"; }
 
 public:
-	MinikClass clas;
-	NativeClass nclas;
-	bool is_native;
-	
-	FieldsMap fields = {};
+	// MinikClass or NativeClass, it owns the shape
+	Ref<MinikCallable> m_class;
+	Shape* shape = nullptr;
+	std::vector<Ref<Object>> fields = {};
+	// native instances keep their fields by name
+	Scope<FieldsMap> native_fields = nullptr;
+
+private:
+	Ref<Object>* find_field_slow(const std::string& name, const FieldCache& cache);
 };
 
-class MinikNamespace {
+// its functions keep the namespace as an Object, the collector traverses it to free the cycle
+class MinikNamespace : public CollectableRoot {
 public:
 	MinikNamespace(const std::string& name, const Ref<MinikNamespace>& parent)
-		: name(name), parent(parent) {}
+		: CollectableRoot(GCKind::NAMESPACE), name(name), parent(parent) {}
 
 	Ref<Object> get(const Token& name);
 
+	void trace(GCTracer& tracer) const;
+	void clear_references();
+
 	const std::string to_string() const { return "<namespace " + name + ">"; }
 
 	const std::string name;
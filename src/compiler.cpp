@@ -0,0 +1,715 @@
+#include "compiler.h"
+#include "base.h"
+#include "expression.h"
+#include "statement.h"
+#include "token.h"
+
+namespace minik {
+
+// thrown when the body uses something the vm does not run,
+// the function is then left to the tree walker
+struct UnsupportedNode {};
+
+
+static int stack_effect(OpCode op, int32_t operand, uint8_t flags) {
+	switch (op) {
+		case OpCode::CONSTANT: case OpCode::NIL: case OpCode::NONE:
+		case OpCode::TRUE: case OpCode::FALSE:
+		case OpCode::GET_LOCAL: case OpCode::GET_CAPTURE: case OpCode::GET_UPPER: case OpCode::GET_GLOBAL:
+		case OpCode::INC_LOCAL: case OpCode::INC_CAPTURE: case OpCode::INC_UPPER: case OpCode::INC_GLOBAL:
+			return 1;
+		case OpCode::POP:
+		case OpCode::SET_PROPERTY:
+		case OpCode::GET_INDEX:
+		case OpCode::INC_INDEX:
+		case OpCode::ADD: case OpCode::SUBTRACT: case OpCode::MULTIPLY:
+		case OpCode::DIVIDE: case OpCode::MODULO:
+		case OpCode::EQUAL: case OpCode::NOT_EQUAL:
+		case OpCode::GREATER: case OpCode::GREATER_EQUAL:
+		case OpCode::LESS: case OpCode::LESS_EQUAL:
+		case OpCode::JUMP_IF_FALSE: case OpCode::JUMP_IF_TRUE_KEEP: case OpCode::JUMP_IF_FALSE_KEEP:
+		case OpCode::RETURN:
+			return -1;
+		case OpCode::SET_INDEX:
+			return (flags & OP_FLAG_ELEMENT) ? -3 : -2;
+		case OpCode::CALL: case OpCode::INVOKE:
+			return -operand;
+		case OpCode::LIST:
+			return 1 - operand;
+		default:
+			return 0;
+	}
+}
+
+
+Ref<Chunk> Compiler::compile(const FunctionStatement& function) {
+	m_chunk = CreateRef<Chunk>();
+	m_chunk->name = function.name.lexeme;
+	m_chunk->arity = function.params.size();
+
+	m_captures.assign(function.body->slot_count, -1);
+	for (size_t i = 0; i < function.captures.size(); ++i) {
+		m_captures[function.captures[i].target] = i;
+	}
+
+	m_in_function = true;
+	try {
+		begin_scope();
+		for (int32_t i = 0; i < (int32_t)function.params.size(); ++i) {
+			declare(i);
+		}
+		if (function.is_method) {
+			declare(function.params.size());
+		}
+		begin_block();
+		compile_block(function.body->statements);
+		emit_deferred(0);
+		end_block();
+		end_scope();
+
+		emit(OpCode::NONE);
+		emit(OpCode::RETURN);
+	} catch (UnsupportedNode) {
+		return nullptr;
+	}
+
+	if (m_has_goto && m_has_defer) {
+		return nullptr;
+	}
+
+	return m_chunk;
+}
+
+// a loop the tree walker reached outside of a compiled function,
+// it runs in a frame of its own and returns nothing
+Ref<Chunk> Compiler::compile(const ForStatement& loop) {
+	m_chunk = CreateRef<Chunk>();
+	m_chunk->name = "loop";
+
+	try {
+		begin_block();
+		compile_loop(loop, loop.label ? loop.label->name.lexeme : "");
+		end_block();
+
+		emit(OpCode::NONE);
+		emit(OpCode::RETURN);
+	} catch (UnsupportedNode) {
+		return nullptr;
+	}
+
+	if (m_has_goto && m_has_defer) {
+		return nullptr;
+	}
+
+	return m_chunk;
+}
+
+
+void Compiler::compile(const Ref<Expression>& expression) {
+	expression->accept(*this);
+}
+void Compiler::compile(const Ref<Statement>& statement) {
+	statement->accept(*this);
+}
+
+void Compiler::compile_block(const std::vector<Ref<Statement>>& statements) {
+	// labels of this block are visible to every goto inside it
+	Block& block = m_blocks.back();
+	for (const Ref<Statement>& statement : statements) {
+		if (statement->kind == StatementKind::LABEL) {
+			block.labels[static_cast<LabelStatement*>(statement.get())->name.lexeme] = -1;
+		}
+	}
+
+	for (const Ref<Statement>& statement : statements) {
+		compile(statement);
+	}
+
+	if (!m_blocks.back().pending_gotos.empty()) {
+		throw UnsupportedNode();
+	}
+}
+
+
+size_t Compiler::emit(OpCode op, int32_t operand, int32_t token, uint8_t flags, uint16_t depth) {
+	m_chunk->code.push_back(Instruction{op, flags, depth, operand, token});
+
+	int effect = stack_effect(op, operand, flags);
+	m_stack_depth += effect;
+	if (m_stack_depth > m_chunk->max_stack) {
+		m_chunk->max_stack = m_stack_depth;
+	}
+	return m_chunk->code.size() - 1;
+}
+
+size_t Compiler::emit_jump(OpCode op) {
+	return emit(op, -1);
+}
+
+void Compiler::patch_jump(size_t at) {
+	patch_jump(at, m_chunk->code.size());
+}
+void Compiler::patch_jump(size_t at, size_t target) {
+	m_chunk->code[at].operand = target;
+}
+
+void Compiler::emit_deferred(size_t down_to_block) {
+	if (m_in_defer) {
+		return;
+	}
+
+	for (size_t b = m_blocks.size(); b-- > down_to_block;) {
+		const std::vector<Ref<Statement>>& deferred = m_blocks[b].deferred;
+		if (deferred.empty()) {
+			continue;
+		}
+
+		// deferred statements are compiled in the scope they were declared in
+		std::vector<CompilerScope> inner_scopes(m_scopes.begin() + m_blocks[b].scope_depth, m_scopes.end());
+		m_scopes.resize(m_blocks[b].scope_depth);
+		m_in_defer = true;
+
+		for (auto it = deferred.rbegin(); it != deferred.rend(); ++it) {
+			compile(*it);
+		}
+
+		m_in_defer = false;
+		m_scopes.insert(m_scopes.end(), inner_scopes.begin(), inner_scopes.end());
+	}
+}
+
+
+int32_t Compiler::add_token(const Token& token) {
+	m_chunk->tokens.push_back(token);
+	return m_chunk->tokens.size() - 1;
+}
+
+int32_t Compiler::add_constant(const Value& value) {
+	m_chunk->constants.push_back(value);
+	return m_chunk->constants.size() - 1;
+}
+
+Compiler::Variable Compiler::resolve(const Binding& binding, const Token& name) {
+	uint8_t flags = 0;
+	if (binding.namespace_depth >= 0) {
+		// the vm only probes the namespace of the function being run, not of an enclosing one
+		if (binding.namespace_depth != (int)m_scopes.size() - 1 || m_captures[binding.namespace_slot] >= 0) {
+			throw UnsupportedNode();
+		}
+		flags = OP_FLAG_NAMESPACE;
+	}
+
+	if (binding.global >= 0) {
+		for (size_t i = 0; i < m_chunk->globals.size(); ++i) {
+			if (m_chunk->globals[i].index == binding.global) {
+				return Variable{Variable::GLOBAL, (int32_t)i, flags};
+			}
+		}
+		m_chunk->globals.push_back(GlobalCache{add_token(name), binding.global});
+		return Variable{Variable::GLOBAL, (int32_t)m_chunk->globals.size() - 1, flags};
+	}
+	if (binding.depth < 0) {
+		throw UnsupportedNode();
+	}
+
+	if (binding.depth == (int)m_scopes.size() - 1 && binding.slot >= 0
+		&& binding.slot < (int)m_captures.size() && m_captures[binding.slot] >= 0) {
+		return Variable{Variable::CAPTURE, m_captures[binding.slot], flags};
+	}
+	if (binding.depth < (int)m_scopes.size()) {
+		// locals declared by name (nested functions, classes) stay in the tree walker
+		const CompilerScope& scope = m_scopes[m_scopes.size() - 1 - binding.depth];
+		if (binding.slot < 0 || binding.slot >= (int)scope.slots.size() || scope.slots[binding.slot] < 0) {
+			throw UnsupportedNode();
+		}
+		return Variable{Variable::LOCAL, scope.slots[binding.slot]};
+	}
+
+	// variables of enclosing functions are captured, what is left is looked up by name,
+	// a loop run for the tree walker also finds the slots of the environments around it
+	uint16_t depth = binding.depth - m_scopes.size();
+	for (size_t i = 0; i < m_chunk->uppers.size(); ++i) {
+		const Upper& upper = m_chunk->uppers[i];
+		if (upper.depth == depth && m_chunk->tokens[upper.name].lexeme == name.lexeme) {
+			return Variable{Variable::UPPER, (int32_t)i, flags};
+		}
+	}
+	m_chunk->uppers.push_back(Upper{add_token(name), binding.slot, depth});
+	return Variable{Variable::UPPER, (int32_t)m_chunk->uppers.size() - 1, flags};
+}
+
+// maps a slot of the resolver scope to a slot of the frame
+int32_t Compiler::declare(int32_t scope_slot) {
+	std::vector<int32_t>& slots = m_scopes.back().slots;
+	if (scope_slot < 0) {
+		throw UnsupportedNode();
+	}
+	if (scope_slot >= (int32_t)slots.size()) {
+		slots.resize(scope_slot + 1, -1);
+	}
+	slots[scope_slot] = m_chunk->slot_count++;
+	return slots[scope_slot];
+}
+
+
+void Compiler::begin_scope() {
+	m_scopes.push_back({});
+}
+void Compiler::end_scope() {
+	m_scopes.pop_back();
+}
+void Compiler::begin_block() {
+	m_blocks.push_back(Block{m_scopes.size()});
+}
+void Compiler::end_block() {
+	m_blocks.pop_back();
+}
+
+Compiler::Loop& Compiler::find_loop(const Token& keyword) {
+	if (m_loops.empty()) {
+		throw UnsupportedNode();
+	}
+	if (keyword.type != IDENTIFIER) {
+		return m_loops.back();
+	}
+	for (size_t i = m_loops.size(); i-- > 0;) {
+		if (m_loops[i].label == keyword.lexeme) {
+			return m_loops[i];
+		}
+	}
+	throw UnsupportedNode();
+}
+
+
+
+void Compiler::visit(const LiteralExpression& e) {
+	const Ref<Object>& value = e.value;
+	if (value->is_nil()) {
+		emit(OpCode::NIL);
+	} else if (value->is_bool()) {
+		emit(value->as_bool() ? OpCode::TRUE : OpCode::FALSE);
+	} else if (value->is_double()) {
+		emit(OpCode::CONSTANT, add_constant(value->value));
+	} else {
+		// literals are copied on every evaluation, like the tree walker does
+		emit(OpCode::CONSTANT, add_constant(value->value), -1, OP_FLAG_COPY);
+	}
+}
+
+void Compiler::visit(const GroupingExpression& e) {
+	compile(e.expression);
+}
+
+void Compiler::visit(const VariableExpression& e) {
+	Variable var = resolve(e.binding, e.name);
+	switch (var.kind) {
+		case Variable::LOCAL:  emit(OpCode::GET_LOCAL,  var.index); break;
+		case Variable::CAPTURE:
+			emit(OpCode::GET_CAPTURE, var.index, var.flags ? add_token(e.name) : -1, var.flags);
+			break;
+		case Variable::UPPER:  emit(OpCode::GET_UPPER,  var.index, -1, var.flags); break;
+		case Variable::GLOBAL: emit(OpCode::GET_GLOBAL, var.index, -1, var.flags); break;
+	}
+}
+
+void Compiler::visit(const ThisExpression& e) {
+	Variable var = resolve(e.binding, e.keyword);
+	switch (var.kind) {
+		case Variable::LOCAL:  emit(OpCode::GET_LOCAL,  var.index); break;
+		case Variable::CAPTURE: emit(OpCode::GET_CAPTURE, var.index); break;
+		case Variable::UPPER:  emit(OpCode::GET_UPPER,  var.index); break;
+		case Variable::GLOBAL: emit(OpCode::GET_GLOBAL, var.index); break;
+	}
+}
+
+void Compiler::visit(const AssignmentExpression& e) {
+	compile(e.value);
+	Variable var = resolve(e.binding, e.name);
+	switch (var.kind) {
+		case Variable::LOCAL:  emit(OpCode::SET_LOCAL,  var.index, -1, OP_FLAG_COPY); break;
+		case Variable::CAPTURE: emit(OpCode::SET_CAPTURE, var.index); break;
+		case Variable::UPPER:  emit(OpCode::SET_UPPER,  var.index); break;
+		case Variable::GLOBAL: emit(OpCode::SET_GLOBAL, var.index); break;
+	}
+}
+
+void Compiler::visit(const LogicalExpression& e) {
+	compile(e.left);
+	size_t end = emit_jump(e.operator_token.type == OR ? OpCode::JUMP_IF_TRUE_KEEP : OpCode::JUMP_IF_FALSE_KEEP);
+	compile(e.right);
+	patch_jump(end);
+}
+
+void Compiler::visit(const CallExpression& e) {
+	if (e.callee->kind == ExpressionKind::GET) {
+		const GetExpression& get = static_cast<const GetExpression&>(*e.callee);
+		compile(get.object);
+		for (const Ref<Expression>& argument : e.arguments) {
+			compile(argument);
+		}
+		m_chunk->invokes.push_back({add_token(get.name)});
+		emit(OpCode::INVOKE, e.arguments.size(), add_token(e.paren), 0, m_chunk->invokes.size() - 1);
+		return;
+	}
+
+	compile(e.callee);
+	for (const Ref<Expression>& argument : e.arguments) {
+		compile(argument);
+	}
+	// the depth field of CALL, INVOKE, GET_PROPERTY and SET_PROPERTY holds the index of their cache
+	m_chunk->calls.push_back({});
+	emit(OpCode::CALL, e.arguments.size(), add_token(e.paren), 0, m_chunk->calls.size() - 1);
+}
+
+void Compiler::visit(const GetExpression& e) {
+	compile(e.object);
+	int32_t name = add_token(e.name);
+	m_chunk->fields.push_back({});
+	emit(OpCode::GET_PROPERTY, name, name, 0, m_chunk->fields.size() - 1);
+}
+
+void Compiler::visit(const SetExpression& e) {
+	compile(e.object);
+	compile(e.value);
+	int32_t name = add_token(e.name);
+	m_chunk->fields.push_back({});
+	emit(OpCode::SET_PROPERTY, name, name, 0, m_chunk->fields.size() - 1);
+}
+
+void Compiler::visit(const SubscriptExpression& e) {
+	compile(e.object);
+	compile(e.key);
+	emit(OpCode::GET_INDEX, 0, add_token(e.name));
+}
+
+void Compiler::visit(const ArrayInitializerExpression& e) {
+	for (const auto& element : e.elements) {
+		compile(element);
+	}
+	emit(OpCode::LIST, e.elements.size(), add_token(e.paren));
+}
+
+void Compiler::visit(const ArrayInitSizeExpression& e) {
+	compile(e.size);
+	emit(OpCode::LIST_SIZED, 0, add_token(e.paren));
+}
+
+void Compiler::visit(const SetSubscriptExpression& e) {
+	// strings are immutable, a changed string is stored back to the variable, field or element it was read from
+	Expression* target = e.object.get();
+	while (target->kind == ExpressionKind::GROUPING) {
+		target = static_cast<GroupingExpression*>(target)->expression.get();
+	}
+
+	switch (target->kind) {
+		case ExpressionKind::VARIABLE: {
+			VariableExpression* v = static_cast<VariableExpression*>(target);
+			compile(e.object);
+			compile(e.index);
+			compile(e.value);
+			emit(OpCode::SET_INDEX, 0, add_token(e.name), OP_FLAG_STORE);
+			// like an assignment, skipped unless a string was changed
+			Variable var = resolve(v->binding, v->name);
+			switch (var.kind) {
+				case Variable::LOCAL:  emit(OpCode::SET_LOCAL,  var.index); break;
+				case Variable::CAPTURE: emit(OpCode::SET_CAPTURE, var.index); break;
+				case Variable::UPPER:  emit(OpCode::SET_UPPER,  var.index); break;
+				case Variable::GLOBAL: emit(OpCode::SET_GLOBAL, var.index); break;
+			}
+			break;
+		}
+		case ExpressionKind::GET: {
+			GetExpression* g = static_cast<GetExpression*>(target);
+			compile(g->object);
+			compile(e.index);
+			compile(e.value);
+			emit(OpCode::SET_INDEX, add_token(g->name), add_token(e.name), OP_FLAG_FIELD);
+			break;
+		}
+		case ExpressionKind::SUBSCRIPT: {
+			SubscriptExpression* s = static_cast<SubscriptExpression*>(target);
+			compile(s->object);
+			compile(s->key);
+			compile(e.index);
+			compile(e.value);
+			emit(OpCode::SET_INDEX, add_token(s->name), add_token(e.name), OP_FLAG_ELEMENT);
+			break;
+		}
+		default:
+			compile(e.object);
+			compile(e.index);
+			compile(e.value);
+			emit(OpCode::SET_INDEX, 0, add_token(e.name));
+			break;
+	}
+}
+
+void Compiler::compile_increment(const UnaryExpression& e, int delta) {
+	// ++ and -- write through to the variable, field or element they were applied to
+	Expression* target = e.right.get();
+	while (target->kind == ExpressionKind::GROUPING) {
+		target = static_cast<GroupingExpression*>(target)->expression.get();
+	}
+
+	int32_t token = add_token(e.operator_token);
+	uint16_t sign = delta > 0 ? 1 : 0;
+
+	switch (target->kind) {
+		case ExpressionKind::VARIABLE: {
+			VariableExpression* v = static_cast<VariableExpression*>(target);
+			Variable var = resolve(v->binding, v->name);
+			if (var.flags & OP_FLAG_NAMESPACE) {
+				// increments don't probe the namespace
+				throw UnsupportedNode();
+			}
+			switch (var.kind) {
+				case Variable::LOCAL:  emit(OpCode::INC_LOCAL,  var.index, token, 0, sign); break;
+				case Variable::CAPTURE: emit(OpCode::INC_CAPTURE, var.index, token, 0, sign); break;
+				case Variable::UPPER:  emit(OpCode::INC_UPPER,  var.index, token, 0, sign); break;
+				case Variable::GLOBAL: emit(OpCode::INC_GLOBAL, var.index, token, 0, sign); break;
+			}
+			break;
+		}
+		case ExpressionKind::GET: {
+			GetExpression* g = static_cast<GetExpression*>(target);
+			compile(g->object);
+			emit(OpCode::INC_PROPERTY, add_token(g->name), token, 0, sign);
+			break;
+		}
+		case ExpressionKind::SUBSCRIPT: {
+			SubscriptExpression* s = static_cast<SubscriptExpression*>(target);
+			compile(s->object);
+			compile(s->key);
+			emit(OpCode::INC_INDEX, add_token(s->name), token, 0, sign);
+			break;
+		}
+		default:
+			compile(e.right);
+			emit(OpCode::INC_VALUE, 0, token, 0, sign);
+			break;
+	}
+}
+
+void Compiler::visit(const UnaryExpression& e) {
+	switch (e.operator_token.type) {
+		case PLUS_PLUS:   compile_increment(e,  1); return;
+		case MINUS_MINUS: compile_increment(e, -1); return;
+		case BANG:
+			compile(e.right);
+			emit(OpCode::NOT, 0, add_token(e.operator_token));
+			return;
+		case MINUS:
+			compile(e.right);
+			emit(OpCode::NEGATE, 0, add_token(e.operator_token));
+			return;
+		default:
+			throw UnsupportedNode();
+	}
+}
+
+void Compiler::visit(const BinaryExpression& e) {
+	compile(e.left);
+	compile(e.right);
+
+	OpCode op;
+	switch (e.operator_token.type) {
+		case PLUS:          op = OpCode::ADD;           break;
+		case MINUS:         op = OpCode::SUBTRACT;      break;
+		case STAR:          op = OpCode::MULTIPLY;      break;
+		case SLASH:         op = OpCode::DIVIDE;        break;
+		case MOD:           op = OpCode::MODULO;        break;
+		case EQUAL_EQUAL:   op = OpCode::EQUAL;         break;
+		case BANG_EQUAL:    op = OpCode::NOT_EQUAL;     break;
+		case GREATER:       op = OpCode::GREATER;       break;
+		case GREATER_EQUAL: op = OpCode::GREATER_EQUAL; break;
+		case LESS:          op = OpCode::LESS;          break;
+		case LESS_EQUAL:    op = OpCode::LESS_EQUAL;    break;
+		default:
+			throw UnsupportedNode();
+	}
+	emit(op, 0, add_token(e.operator_token));
+}
+
+
+
+void Compiler::visit(const ExpressionStatement& s) {
+	compile(s.expression);
+	emit(OpCode::POP);
+}
+
+void Compiler::visit(const VariableStatement& s) {
+	if (m_in_defer) {
+		throw UnsupportedNode();
+	}
+	if (s.initializer) {
+		compile(s.initializer);
+	} else {
+		emit(OpCode::NONE);
+	}
+	emit(OpCode::SET_LOCAL, declare(s.slot), -1, OP_FLAG_COPY);
+	emit(OpCode::POP);
+}
+
+void Compiler::visit(const BlockStatement& s) {
+	if (s.scoped) {
+		begin_scope();
+	}
+	begin_block();
+	compile_block(s.statements);
+	emit_deferred(m_blocks.size() - 1);
+	end_block();
+	if (s.scoped) {
+		end_scope();
+	}
+}
+
+void Compiler::visit(const IfStatement& s) {
+	compile(s.condition);
+	size_t else_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+	compile(s.then_branch);
+
+	if (s.else_branch) {
+		size_t end_jump = emit_jump(OpCode::JUMP);
+		patch_jump(else_jump);
+		compile(s.else_branch);
+		patch_jump(end_jump);
+	} else {
+		patch_jump(else_jump);
+	}
+}
+
+void Compiler::compile_loop(const ForStatement& s, const std::string& label) {
+	if (s.scoped) {
+		begin_scope();
+	}
+	if (s.initializer) {
+		compile(s.initializer);
+	}
+
+	m_loops.push_back(Loop{label, m_blocks.size()});
+
+	size_t loop_start = m_chunk->code.size();
+	compile(s.condition);
+	size_t exit_jump = emit_jump(OpCode::JUMP_IF_FALSE);
+
+	compile(s.body);
+
+	size_t continue_target = m_chunk->code.size();
+	if (s.increment) {
+		compile(s.increment);
+		emit(OpCode::POP);
+	}
+	emit(OpCode::JUMP, loop_start);
+	patch_jump(exit_jump);
+
+	Loop& loop = m_loops.back();
+	for (size_t at : loop.breaks) {
+		patch_jump(at);
+	}
+	for (size_t at : loop.continues) {
+		patch_jump(at, continue_target);
+	}
+	m_loops.pop_back();
+
+	if (s.scoped) {
+		end_scope();
+	}
+}
+
+void Compiler::visit(const ForStatement& s) {
+	compile_loop(s, "");
+}
+
+void Compiler::visit(const BreakStatement& s) {
+	if (m_in_defer) {
+		throw UnsupportedNode();
+	}
+	Loop& loop = find_loop(s.keyword);
+	emit_deferred(loop.block_depth);
+	loop.breaks.push_back(emit_jump(OpCode::JUMP));
+}
+
+void Compiler::visit(const ContinueStatement& s) {
+	if (m_in_defer) {
+		throw UnsupportedNode();
+	}
+	Loop& loop = find_loop(s.keyword);
+	emit_deferred(loop.block_depth);
+	loop.continues.push_back(emit_jump(OpCode::JUMP));
+}
+
+void Compiler::visit(const ReturnStatement& s) {
+	// a loop can't return from the function the tree walker is running
+	if (m_in_defer || !m_in_function) {
+		throw UnsupportedNode();
+	}
+	if (s.value) {
+		compile(s.value);
+	} else {
+		emit(OpCode::NONE);
+	}
+	emit_deferred(0);
+	emit(OpCode::RETURN);
+}
+
+void Compiler::visit(const DeferStatement& s) {
+	if (m_in_defer) {
+		throw UnsupportedNode();
+	}
+	m_has_defer = true;
+	m_blocks.back().deferred.push_back(s.statement);
+}
+
+void Compiler::visit(const LabelStatement& s) {
+	if (m_in_defer) {
+		throw UnsupportedNode();
+	}
+	if (s.loop) {
+		compile_loop(*s.loop, s.name.lexeme);
+		return;
+	}
+
+	Block& block = m_blocks.back();
+	int32_t target = m_chunk->code.size();
+	block.labels[s.name.lexeme] = target;
+
+	auto pending = block.pending_gotos.find(s.name.lexeme);
+	if (pending != block.pending_gotos.end()) {
+		for (size_t at : pending->second) {
+			patch_jump(at, target);
+		}
+		block.pending_gotos.erase(pending);
+	}
+}
+
+void Compiler::visit(const GotoStatement& s) {
+	if (m_in_defer) {
+		throw UnsupportedNode();
+	}
+	m_has_goto = true;
+
+	for (size_t b = m_blocks.size(); b-- > 0;) {
+		Block& block = m_blocks[b];
+		auto label = block.labels.find(s.label.lexeme);
+		if (label == block.labels.end()) {
+			continue;
+		}
+
+		if (label->second >= 0) {
+			emit(OpCode::JUMP, label->second);
+		} else {
+			block.pending_gotos[s.label.lexeme].push_back(emit_jump(OpCode::JUMP));
+		}
+		return;
+	}
+
+	throw UnsupportedNode();
+}
+
+
+void Compiler::visit(const FunctionStatement& s)  { throw UnsupportedNode(); }
+void Compiler::visit(const ClassStatement& s)     { throw UnsupportedNode(); }
+void Compiler::visit(const NamespaceStatement& s) { throw UnsupportedNode(); }
+void Compiler::visit(const ImportStatement& s)    { throw UnsupportedNode(); }
+
+}
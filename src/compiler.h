@@ -0,0 +1,124 @@
+#pragma once
+
+#include "chunk.h"
+#include "interpreter.h"
+#include "statement.h"
+#include "visitor.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace minik {
+
+// Lowers a resolved function body, or a loop of code the tree walker runs, to a Chunk for the VM.
+// Bodies that declare functions, classes, namespaces or imports,
+// or that mix goto with defer, are left to the tree walker.
+class Compiler : public Visitor {
+public:
+	Compiler(Interpreter& interpreter)
+		: m_interpreter(interpreter) {}
+
+	Ref<Chunk> compile(const FunctionStatement& function);
+	Ref<Chunk> compile(const ForStatement& loop);
+
+	virtual void visit(const LiteralExpression& e)    override;
+	virtual void visit(const BinaryExpression& e)     override;
+	virtual void visit(const UnaryExpression& e)      override;
+	virtual void visit(const GroupingExpression& e)   override;
+	virtual void visit(const VariableExpression& e)   override;
+	virtual void visit(const AssignmentExpression& e) override;
+	virtual void visit(const LogicalExpression& e)    override;
+	virtual void visit(const CallExpression& e)       override;
+	virtual void visit(const GetExpression& e)        override;
+	virtual void visit(const SetExpression& e)        override;
+	virtual void visit(const ThisExpression& e)       override;
+	virtual void visit(const SubscriptExpression& e)  override;
+	virtual void visit(const ArrayInitializerExpression& e) override;
+	virtual void visit(const ArrayInitSizeExpression& e) override;
+	virtual void visit(const SetSubscriptExpression& e) override;
+
+	virtual void visit(const ExpressionStatement& s) override;
+	virtual void visit(const VariableStatement& s)   override;
+	virtual void visit(const BlockStatement& s)      override;
+	virtual void visit(const IfStatement& s)         override;
+	virtual void visit(const ForStatement& s)        override;
+	virtual void visit(const BreakStatement& s)      override;
+	virtual void visit(const ContinueStatement& s)   override;
+	virtual void visit(const FunctionStatement& s)   override;
+	virtual void visit(const ReturnStatement& s)     override;
+	virtual void visit(const ClassStatement& s)      override;
+	virtual void visit(const NamespaceStatement& s)  override;
+	virtual void visit(const DeferStatement& s)      override;
+	virtual void visit(const LabelStatement& s)      override;
+	virtual void visit(const GotoStatement& s)       override;
+	virtual void visit(const ImportStatement& s)     override;
+
+private:
+	struct Variable {
+		enum Kind { LOCAL, CAPTURE, UPPER, GLOBAL } kind;
+		int32_t index;
+		uint8_t flags = 0;
+	};
+
+	struct CompilerScope {
+		// frame slot of each resolver slot, -1 until declared
+		std::vector<int32_t> slots = {};
+	};
+
+	struct Block {
+		size_t scope_depth;
+		std::vector<Ref<Statement>> deferred = {};
+		std::unordered_map<std::string, int32_t> labels = {};
+		std::unordered_map<std::string, std::vector<size_t>> pending_gotos = {};
+	};
+
+	struct Loop {
+		std::string label;
+		size_t block_depth;
+		size_t continue_target = 0;
+		std::vector<size_t> breaks = {};
+		std::vector<size_t> continues = {};
+	};
+
+	void compile(const Ref<Expression>& expression);
+	void compile(const Ref<Statement>& statement);
+	void compile_block(const std::vector<Ref<Statement>>& statements);
+	void compile_loop(const ForStatement& s, const std::string& label);
+	void compile_increment(const UnaryExpression& e, int delta);
+
+	size_t emit(OpCode op, int32_t operand = 0, int32_t token = -1, uint8_t flags = 0, uint16_t depth = 0);
+	size_t emit_jump(OpCode op);
+	void patch_jump(size_t at);
+	void patch_jump(size_t at, size_t target);
+	void emit_deferred(size_t down_to_block);
+
+	int32_t add_token(const Token& token);
+	int32_t add_constant(const Value& value);
+	Variable resolve(const Binding& binding, const Token& name);
+	int32_t declare(int32_t scope_slot);
+
+	void begin_scope();
+	void end_scope();
+	void begin_block();
+	void end_block();
+
+	Loop& find_loop(const Token& keyword);
+
+private:
+	Interpreter& m_interpreter;
+	Ref<Chunk> m_chunk = nullptr;
+
+	std::vector<CompilerScope> m_scopes = {};
+	// index in the captures of the function of each slot it copies a capture to, -1 otherwise
+	std::vector<int32_t> m_captures = {};
+	std::vector<Block> m_blocks = {};
+	std::vector<Loop> m_loops = {};
+	bool m_in_function = false;
+	bool m_in_defer = false;
+	bool m_has_goto = false;
+	bool m_has_defer = false;
+
+	uint32_t m_stack_depth = 0;
+};
+
+}
@@ -4,35 +4,64 @@
 #include "log.h"
 #include "minik.h"
 #include "object.h"
+#include "pool.h"
 #include <cassert>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace minik {
 
-class Environment {
+class Environment : public CollectableRoot, public Pooled<PoolType::ENVIRONMENT> {
 public:
-	Environment() : enclosing(nullptr) {}
-	Environment(const Ref<Environment>& enclosing) : enclosing(enclosing) {}
+	Environment() : CollectableRoot(GCKind::ENVIRONMENT), enclosing(nullptr) {}
+	Environment(const Ref<Environment>& enclosing, int slot_count = 0)
+		: CollectableRoot(GCKind::ENVIRONMENT), enclosing(enclosing), slots(slot_count) {}
+
+	// locals live in slots assigned by the resolver,
+	// globals, namespaces and hoisted declarations are looked up by name
+	void define(int slot, const Ref<Object>& value) {
+		Ref<Object>& cell = slots[slot];
+		if (cell) {
+			// already captured by a function created before the declaration ran
+			cell->value = value ? value->value : Value();
+			return;
+		}
+		cell = value;
+	}
+	// cell of a variable copied into a closure, created if it is not declared yet
+	const Ref<Object>& capture(int distance, int slot) {
+		Ref<Object>& cell = ancestor(distance)->slots[slot];
+		if (!cell) {
+			cell = CreateRef<Object>();
+		}
+		return cell;
+	}
+	const Ref<Object>& get_at(int distance, int slot) {
+		return ancestor(distance)->slots[slot];
+	}
 
 	void predefine(const Token& name, const Ref<Object>& value) {
-		values.emplace(name.lexeme, Symbol{false, value});
+		Symbol& symbol = symbols[index_of(name.lexeme)];
+		if (!symbol.present) {
+			symbol = Symbol{false, value, true};
+		}
 	}
 	void define(const Token& name, const Ref<Object>& value) {
-		if (values.count(name.lexeme) > 0) {
-			if (values.at(name.lexeme).defined) {
+		Symbol& symbol = symbols[index_of(name.lexeme)];
+		if (symbol.present) {
+			if (symbol.defined) {
 				throw InterpreterException(name, "Redefinition of '" + name.lexeme + "'.");
-			} else {
-				values.at(name.lexeme).defined = true;
-				return;
 			}
+			symbol.defined = true;
+			return;
 		}
-		values.emplace(name.lexeme, Symbol{true, value});
+		symbol = Symbol{true, value, true};
 	}
 
 	bool has(const std::string& name) {
-		auto it = values.find(name);
-		if (it != values.end()) {
+		auto it = indices.find(name);
+		if (it != indices.end() && symbols[it->second].present) {
 			return true;
 		}
 		if (enclosing) {
@@ -42,9 +71,9 @@ public:
 	}
 
 	Ref<Object> get(const Token& name) {
-		auto it = values.find(name.lexeme);
-		if (it != values.end()) {
-			return it->second.object;
+		auto it = indices.find(name.lexeme);
+		if (it != indices.end() && symbols[it->second].present) {
+			return symbols[it->second].object;
 		}
 	
 		if (enclosing) {
@@ -58,9 +87,9 @@ public:
 		Environment* env = ancestor(distance);
 
 		if (env) {
-			auto it = env->values.find(name.lexeme);
-			if (it != env->values.end()) {
-				return it->second.object;
+			auto it = env->indices.find(name.lexeme);
+			if (it != env->indices.end() && env->symbols[it->second].present) {
+				return env->symbols[it->second].object;
 			}
 		}
 
@@ -70,6 +99,70 @@ public:
 				+std::to_string(name.line)+"] (distance "+std::to_string(distance)+", token '"+name.lexeme+"')");
 	}
 
+	// the global environment hands out a stable index for each name, the resolver
+	// reserves them so reads of globals are array loads
+	int index_of(const std::string& name) {
+		auto it = indices.find(name);
+		if (it != indices.end()) {
+			return it->second;
+		}
+		indices.emplace(name, symbols.size());
+		symbols.push_back({});
+		return symbols.size() - 1;
+	}
+	const Ref<Object>& get_global(int index, const Token& name) {
+		const Symbol& symbol = symbols[index];
+		if (!symbol.present) {
+			throw InterpreterException(name, "Undefined variable '" + name.lexeme + "'.");
+		}
+		return symbol.object;
+	}
+
+	// empties the environment so a loop can run its next iteration in it,
+	// cells captured by closures are released, not cleared
+	void reset() {
+		for (Ref<Object>& slot : slots) {
+			slot = nullptr;
+		}
+		if (!symbols.empty()) {
+			indices.clear();
+			symbols.clear();
+		}
+	}
+
+	// only an environment a function or class keeps as its closure can be part of a cycle,
+	// the others are not buffered when a reference is dropped
+	bool release_ref() const {
+		if (--m_ref_count == 0) {
+			return true;
+		}
+		if (gc_flag() && gc_root() == 0) {
+			gc_possible_root(this);
+		}
+		return false;
+	}
+	void keep_as_closure() {
+		for (Environment* env = this; env && !env->gc_flag(); env = env->enclosing.get()) {
+			env->set_gc_flag();
+		}
+	}
+
+	void trace(GCTracer& tracer) const {
+		tracer.visit(enclosing);
+		for (const Ref<Object>& slot : slots) {
+			tracer.visit(slot);
+		}
+		for (const Symbol& symbol : symbols) {
+			tracer.visit(symbol.object);
+		}
+	}
+	void clear_references() {
+		enclosing = nullptr;
+		slots.clear();
+		symbols.clear();
+		indices.clear();
+	}
+
 	Environment* ancestor(int distance) {
 		Environment* env = this;
 		for (int i = 0; i < distance; ++i) {
@@ -84,8 +177,12 @@ private:
 	struct Symbol {
 		bool defined = false;
 		Ref<Object> object;
+		// false while the index is only reserved by the resolver
+		bool present = false;
 	};
-	std::unordered_map<std::string, Symbol> values = {};
+	std::unordered_map<std::string, int> indices = {};
+	std::vector<Symbol> symbols = {};
+	std::vector<Ref<Object>> slots;
 };
 
 }
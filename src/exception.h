@@ -1,5 +1,7 @@
 #pragma once
 
+#include "minik.h"
+#include "object.h"
 #include "token.h"
 #include <exception>
 #include <string>
@@ -48,19 +50,6 @@ void report_runtime_error(const InterpreterException& e);
 
 
 
-struct BreakException {
-	const Token label;
-};
-struct ContinueException {
-	const Token label;
-};
-struct GotoException {
-	const Token label;
-};
 struct AssertException {};
 
-struct ReturnException {
-	Ref<Object> value;
-};
-
 }
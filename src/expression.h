@@ -1,5 +1,6 @@
 #pragma once
 
+#include "object.h"
 #include "token.h"
 #include "visitor.h"
 #include <vector>
@@ -7,17 +8,41 @@
 
 namespace minik {
 
-struct Expression {
+enum class ExpressionKind {
+	LITERAL, BINARY, UNARY, GROUPING,
+	VARIABLE, ASSIGNMENT, LOGICAL, CALL,
+	GET, SET, THIS, SUBSCRIPT,
+	ARRAY_INITIALIZER, ARRAY_INIT_SIZE, SET_SUBSCRIPT
+};
+
+struct Expression : public RefCounted {
+	// set by the constructor of each node, type tests switch on it
+	const ExpressionKind kind;
+
+	Expression(ExpressionKind kind) : kind(kind) {}
 	virtual ~Expression() = default;
 	virtual void accept(Visitor& visitor) {}
 };
 
+// where the resolver found a variable, depth -1 is a global.
+// a variable without a slot is looked up by name in the environment at depth
+struct Binding {
+	int depth = -1;
+	int slot = -1;
+	// set when a function declared in a namespace reads a variable that is not local to it,
+	// the fields of the namespace stored at this depth and slot are searched first
+	int namespace_depth = -1;
+	int namespace_slot = -1;
+	// index in the global table, set for names that resolve to the global scope
+	int global = -1;
+};
+
 
 struct LiteralExpression : public Expression {
 	Ref<Object> value;
 
 	LiteralExpression(Ref<Object> val)
-		: value(val) {}
+		: Expression(ExpressionKind::LITERAL), value(val) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -28,7 +53,7 @@ struct BinaryExpression : public Expression {
 	Ref<Expression> right;
 
 	BinaryExpression(Ref<Expression> l, Token op, Ref<Expression> r)
-		: left(l), operator_token(op), right(r) {}
+		: Expression(ExpressionKind::BINARY), left(l), operator_token(op), right(r) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -38,7 +63,7 @@ struct UnaryExpression : public Expression {
 	Ref<Expression> right;
 
 	UnaryExpression(Token op, Ref<Expression> rhs)
-		: operator_token(op), right(rhs) {}
+		: Expression(ExpressionKind::UNARY), operator_token(op), right(rhs) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -47,16 +72,17 @@ struct GroupingExpression : public Expression {
 	Ref<Expression> expression;
 
 	GroupingExpression(Ref<Expression> expr)
-		: expression(expr) {}
+		: Expression(ExpressionKind::GROUPING), expression(expr) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
 
 struct VariableExpression : public Expression {
 	Token name;
+	Binding binding;
 
 	VariableExpression(const Token& name)
-		: name(name) {}
+		: Expression(ExpressionKind::VARIABLE), name(name) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -64,9 +90,10 @@ struct VariableExpression : public Expression {
 struct AssignmentExpression : public Expression {
 	Token name;
 	Ref<Expression> value;
+	Binding binding;
 
 	AssignmentExpression(const Token& name, Ref<Expression> value)
-		: name(name), value(value) {}
+		: Expression(ExpressionKind::ASSIGNMENT), name(name), value(value) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -77,7 +104,7 @@ struct LogicalExpression : public Expression {
 	Ref<Expression> right;
 
 	LogicalExpression(Ref<Expression> l, Token op, Ref<Expression> r)
-		: left(l), operator_token(op), right(r) {}
+		: Expression(ExpressionKind::LOGICAL), left(l), operator_token(op), right(r) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -86,9 +113,16 @@ struct CallExpression : public Expression {
 	Ref<Expression> callee;
 	Token paren;
 	std::vector<Ref<Expression>> arguments;
+	// monomorphic inline cache, the id of the last callee whose arity matched the arguments.
+	// Not a reference, the body of a recursive function would keep the function alive
+	mutable uint64_t cached_callee = 0;
+	// whether the vm runs it, the arguments are then passed as values
+	mutable bool cached_compiled = false;
+	// method of the last instance a call of obj.method() was made on
+	MethodCache method_cache;
 
 	CallExpression(Ref<Expression> callee, Token paren, std::vector<Ref<Expression>> arguments)
-		: callee(callee), paren(paren), arguments(arguments) {}
+		: Expression(ExpressionKind::CALL), callee(callee), paren(paren), arguments(arguments) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -96,9 +130,10 @@ struct CallExpression : public Expression {
 struct GetExpression : public Expression {
 	Ref<Expression> object;
 	Token name;
+	FieldCache cache;
 
 	GetExpression(Ref<Expression> object, Token name)
-		: object(object), name(name) {}
+		: Expression(ExpressionKind::GET), object(object), name(name) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -106,18 +141,20 @@ struct SetExpression : public Expression {
 	Ref<Expression> object;
 	Ref<Expression> value;
 	Token name;
+	FieldCache cache;
 
 	SetExpression(Ref<Expression> object, Ref<Expression> value, Token name)
-		: object(object), value(value), name(name) {}
+		: Expression(ExpressionKind::SET), object(object), value(value), name(name) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
 
 struct ThisExpression : public Expression {
 	Token keyword;
+	Binding binding;
 
 	ThisExpression(Token keyword)
-		: keyword(keyword) {}
+		: Expression(ExpressionKind::THIS), keyword(keyword) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -128,7 +165,7 @@ struct SubscriptExpression : public Expression {
 	Token name;
 
 	SubscriptExpression(const Ref<Expression>& object, const Ref<Expression>& key, const Token& name)
-		: object(object), key(key), name(name) {}
+		: Expression(ExpressionKind::SUBSCRIPT), object(object), key(key), name(name) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -138,7 +175,7 @@ struct ArrayInitializerExpression : public Expression {
 	Token paren;
 
 	ArrayInitializerExpression(const std::vector<Ref<Expression>>& elements, Token paren)
-		: elements(elements), paren(paren) {}
+		: Expression(ExpressionKind::ARRAY_INITIALIZER), elements(elements), paren(paren) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -147,7 +184,7 @@ struct ArrayInitSizeExpression : public Expression {
 	Token paren;
 
 	ArrayInitSizeExpression(const Ref<Expression>& size, Token paren)
-		: size(size), paren(paren) {}
+		: Expression(ExpressionKind::ARRAY_INIT_SIZE), size(size), paren(paren) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -159,7 +196,7 @@ struct SetSubscriptExpression : public Expression {
 	Token name;
 
 	SetSubscriptExpression(Ref<Expression> object, Ref<Expression> index, Ref<Expression> value, Token name)
-		: object(object), index(index), value(value), name(name) {}
+		: Expression(ExpressionKind::SET_SUBSCRIPT), object(object), index(index), value(value), name(name) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
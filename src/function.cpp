@@ -9,33 +9,72 @@
 namespace minik {
 
 
+void MinikFunction::trace(GCTracer& tracer) const {
+	tracer.visit(m_closure);
+	for (const Ref<Object>& cell : m_captures) {
+		tracer.visit(cell);
+	}
+	for (const Ref<Object>& cell : m_uppers) {
+		tracer.visit(cell);
+	}
+	tracer.visit(m_this);
+	tracer.visit(m_namespace);
+	tracer.visit(m_callable);
+}
+
+void MinikFunction::clear_references() {
+	m_closure = nullptr;
+	m_captures.clear();
+	m_uppers.clear();
+	m_this = nullptr;
+	m_namespace = nullptr;
+	m_callable = nullptr;
+}
+
 Ref<Object> MinikFunction::call(Interpreter& interpreter, const std::vector<Ref<Object>>& arguments) {
-	Ref<Environment> env = CreateRef<Environment>(m_closure);
+	return invoke(interpreter, arguments, m_this);
+}
+
+// methods are called with the instance in self, the bound ones with the instance they were bound to
+Ref<Object> MinikFunction::invoke(Interpreter& interpreter, const Arguments& arguments, const Ref<Object>& self) {
 	if (m_callable) {
 		return m_callable->call(interpreter, arguments);
 	}
 
+	if (interpreter.m_vm) {
+		if (const Chunk* chunk = interpreter.m_vm->compile(*this)) {
+			return interpreter.m_vm->call(*this, *chunk, arguments, self);
+		}
+	}
+
+	Ref<Environment> env = CreateRef<Environment>(m_closure, m_declaration.body->slot_count);
+
 	for (int i = 0; i < m_declaration.params.size(); i++) {
-		env->define(m_declaration.params[i], arguments[i]);
+		env->define(i, arguments[i]);
 	}
 
 	if (m_namespace) {
-		env->define(NAMESPACE_TOKEN, m_namespace);
+		// the resolver reserved the slot after the parameters
+		env->define((int)m_declaration.params.size(), m_namespace);
+	} else if (m_declaration.is_method) {
+		env->define((int)m_declaration.params.size(), self);
+	}
+	for (size_t i = 0; i < m_captures.size(); ++i) {
+		env->define(m_declaration.captures[i].target, m_captures[i]);
 	}
 
-	try {
-		interpreter.execute_block(m_declaration.body->statements, env, m_declaration.body->deferred_statements);
-	} catch (ReturnException e) {
-		if (m_is_initializer) {
-			return m_closure->get_at(0,THIS_TOKEN);
-		}
-		return e.value;
+	interpreter.execute_block(*m_declaration.body, env);
+
+	Ref<Object> value = nullptr;
+	if (interpreter.m_completion == Completion::RETURN) {
+		value = std::move(interpreter.m_return_value);
 	}
+	interpreter.m_completion = Completion::NORMAL;
 
 	if (m_is_initializer) {
-		return m_closure->get_at(0,THIS_TOKEN);
+		return self;
 	}
-	return nullptr;
+	return value;
 }
 
 int MinikFunction::arity() {
@@ -52,14 +91,23 @@ std::string MinikFunction::to_string() const {
 	return "<fn " + m_declaration.name.lexeme + ">";
 }
 
-Ref<MinikFunction> MinikFunction::bind(const Ref<MinikInstance>& instance) {
-	Ref<Environment> env = CreateRef<Environment>(m_closure);
-	env->define(THIS_TOKEN, CreateRef<Object>(instance));
-
-	if (m_callable) {
-		return CreateRef<MinikFunction>(m_callable, env, m_is_initializer, m_namespace);
+void MinikFunction::capture() {
+	m_captures.reserve(m_declaration.captures.size());
+	for (const Capture& captured : m_declaration.captures) {
+		m_captures.push_back(m_closure->capture(captured.depth, captured.slot));
+	}
+	if (!m_declaration.needs_closure) {
+		m_closure = nullptr;
+	} else if (m_closure) {
+		m_closure->keep_as_closure();
 	}
-	return CreateRef<MinikFunction>(m_declaration, env, m_is_initializer, m_namespace);
+}
+
+// a method used as a value, calls of obj.method() invoke it without binding
+Ref<MinikFunction> MinikFunction::bind(const Ref<MinikInstance>& instance) {
+	Ref<MinikFunction> bound = CreateRef<MinikFunction>(*this);
+	bound->m_this = CreateRef<Object>(instance);
+	return bound;
 }
 
 }
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "callable.h"
+#include "chunk.h"
 #include "environment.h"
+#include "pool.h"
 #include "statement.h"
 
 namespace minik {
 
-class MinikFunction : public MinikCallable {
+class MinikFunction : public MinikCallable, public Pooled<PoolType::FUNCTION> {
 public:
 	MinikFunction(
 		const FunctionStatement& declaration,
@@ -18,7 +20,9 @@ public:
 		m_closure(closure),
 		m_is_initializer(is_initializer),
 		m_namespace(ns)
-	{}
+	{
+		capture();
+	}
 
 
 	MinikFunction(
@@ -27,25 +31,51 @@ public:
 		bool is_initializer,
 		const Ref<Object>& ns
 	)
-		: m_declaration({Token{IDENTIFIER,"",nullptr,0},{{}},nullptr}),
+		: m_declaration({Token{IDENTIFIER,"",0},{{}},nullptr}),
 		m_closure(closure),
 		m_is_initializer(is_initializer),
 		m_namespace(ns),
 		m_callable(callable)
-	{}
+	{
+		if (m_closure) {
+			m_closure->keep_as_closure();
+		}
+	}
 
 	virtual int arity() override;
 	virtual std::string to_string() const override;
 	virtual Ref<Object> call(Interpreter& interpreter, const std::vector<Ref<Object>>& arguments) override;
+	Ref<Object> invoke(Interpreter& interpreter, const Arguments& arguments, const Ref<Object>& self);
 
 	Ref<MinikFunction> bind(const Ref<MinikInstance>& instance);
 
+	virtual void trace(GCTracer& tracer) const override;
+	virtual void clear_references() override;
+
+	// null until the vm compiles it, and when the body can't be compiled
+	const Chunk* chunk() const { return m_chunk; }
+
+private:
+	void capture();
+
 private:
 	FunctionStatement m_declaration;
+	// only kept when the body looks up an enclosing variable by name
 	Ref<Environment> m_closure;
+	// cells of the enclosing variables the body uses, see Capture
+	std::vector<Ref<Object>> m_captures;
+	// cells the vm found in the closure for the uppers of the chunk, see Upper
+	std::vector<Ref<Object>> m_uppers;
+	// the instance of a bound method
+	Ref<Object> m_this = nullptr;
 	Ref<Object> m_namespace;
 	bool m_is_initializer;
 	Ref<MinikCallable> m_callable = nullptr;
+
+	// set by the vm, m_chunk stays null if the body can't be compiled
+	const Chunk* m_chunk = nullptr;
+	bool m_compiled = false;
+friend class VM;
 };
 
 }
@@ -0,0 +1,421 @@
+#include "gc.h"
+#include "class.h"
+#include "environment.h"
+#include "function.h"
+#include "log.h"
+#include "object.h"
+#include "pool.h"
+#include "value.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace minik {
+
+static thread_local CycleCollector* t_current = nullptr;
+thread_local CycleCollector* CycleCollector::s_pending = nullptr;
+static size_t s_threshold = CycleCollector::DEFAULT_THRESHOLD;
+static bool s_print_stats = false;
+static size_t s_free_budget = CycleCollector::DEFAULT_FREE_BUDGET;
+
+// objects whose count dropped to zero while too many were being destroyed
+static thread_local std::vector<const GCHeader*> t_queue;
+// elements of large lists, released one at a time
+static thread_local std::vector<List> t_lists;
+// nested destructions in progress and the objects they may still destroy,
+// past the depth or the budget the objects are queued
+static thread_local size_t t_depth = 0;
+static thread_local size_t t_budget = 0;
+// set when something is queued, cheaper to test than the queues
+static thread_local bool t_queued = false;
+static constexpr size_t MAX_DEPTH = 64;
+// lists with more elements are not released at once
+static constexpr size_t LARGE_LIST = 256;
+
+template<typename F>
+struct Tracer : public GCTracer {
+	F f;
+	Tracer(F f) : f(f) {}
+	virtual void visit(const GCHeader* child) override { f(child); }
+};
+
+template<typename F>
+static void trace(const GCHeader* node, F f) {
+	Tracer<F> tracer(f);
+	switch (node->gc_kind()) {
+		case GCKind::OBJECT:      static_cast<const Object*>(node)->trace(tracer); break;
+		case GCKind::ENVIRONMENT: static_cast<const Environment*>(node)->trace(tracer); break;
+		case GCKind::CALLABLE:    static_cast<const MinikCallable*>(node)->trace(tracer); break;
+		case GCKind::INSTANCE:    static_cast<const MinikInstance*>(node)->trace(tracer); break;
+		case GCKind::NAMESPACE:   static_cast<const MinikNamespace*>(node)->trace(tracer); break;
+		case GCKind::LIST_CELL:
+		case GCKind::CALLABLE_CELL:
+		case GCKind::INSTANCE_CELL:
+		case GCKind::NAMESPACE_CELL:
+		case GCKind::LIST_BUFFER:
+			Value::trace_cell(node, tracer);
+			break;
+		default: break;
+	}
+}
+
+static void clear_references(const GCHeader* node) {
+	switch (node->gc_kind()) {
+		case GCKind::OBJECT:      const_cast<Object*>(static_cast<const Object*>(node))->value = nullptr; break;
+		case GCKind::ENVIRONMENT: const_cast<Environment*>(static_cast<const Environment*>(node))->clear_references(); break;
+		case GCKind::CALLABLE:    const_cast<MinikCallable*>(static_cast<const MinikCallable*>(node))->clear_references(); break;
+		case GCKind::INSTANCE:    const_cast<MinikInstance*>(static_cast<const MinikInstance*>(node))->clear_references(); break;
+		case GCKind::NAMESPACE:   const_cast<MinikNamespace*>(static_cast<const MinikNamespace*>(node))->clear_references(); break;
+		case GCKind::LIST_CELL:
+		case GCKind::CALLABLE_CELL:
+		case GCKind::INSTANCE_CELL:
+		case GCKind::NAMESPACE_CELL:
+		case GCKind::LIST_BUFFER:
+			Value::clear_cell(node);
+			break;
+		default: break;
+	}
+}
+
+static void destroy(const GCHeader* node) {
+	switch (node->gc_kind()) {
+		case GCKind::OBJECT:      delete static_cast<const Object*>(node); break;
+		case GCKind::ENVIRONMENT: delete static_cast<const Environment*>(node); break;
+		case GCKind::CALLABLE:    delete static_cast<const MinikCallable*>(node); break;
+		case GCKind::INSTANCE:    delete static_cast<const MinikInstance*>(node); break;
+		case GCKind::NAMESPACE:   delete static_cast<const MinikNamespace*>(node); break;
+		case GCKind::LIST_CELL: {
+			List list = Value::take_list(node);
+			if (list.size() > LARGE_LIST) {
+				t_lists.push_back(std::move(list));
+				t_queued = true;
+			}
+			Value::destroy_cell(node);
+			break;
+		}
+		case GCKind::CALLABLE_CELL:
+		case GCKind::INSTANCE_CELL:
+		case GCKind::NAMESPACE_CELL:
+		case GCKind::LIST_BUFFER:
+			Value::destroy_cell(node);
+			break;
+		default: break;
+	}
+}
+
+
+void gc_possible_root(const GCHeader* node) {
+	if (t_current) {
+		t_current->add_root(node);
+	}
+}
+
+void gc_forget_root(const GCHeader* node) {
+	if (t_current) {
+		t_current->remove_root(node);
+	}
+}
+
+// destroys queued objects until the queue is empty or the budget is spent,
+// the last queued first so a long chain is walked without growing the queue
+static void destroy_queued(size_t budget) {
+	t_budget = budget;
+	t_depth++;
+	while (t_budget > 0) {
+		if (!t_queue.empty()) {
+			const GCHeader* node = t_queue.back();
+			t_queue.pop_back();
+			t_budget--;
+			destroy(node);
+		} else if (!t_lists.empty()) {
+			// the elements go through gc_release if these were their last references
+			List& list = t_lists.back();
+			const size_t count = std::min(t_budget, list.size());
+			t_budget -= count;
+			list.resize(list.size() - count);
+			if (list.empty()) {
+				t_lists.pop_back();
+			}
+		} else {
+			break;
+		}
+	}
+	t_depth--;
+}
+
+static bool has_queued() {
+	if (t_queued) {
+		t_queued = !t_queue.empty() || !t_lists.empty();
+	}
+	return t_queued;
+}
+
+// outside of an interpreter there is no safe point to finish later
+static size_t step_budget() {
+	return t_current && s_free_budget ? s_free_budget : SIZE_MAX;
+}
+
+void gc_release(const GCHeader* node) {
+	if (node->gc_root() != 0) {
+		gc_forget_root(node);
+	}
+	if (t_depth == 0) {
+		t_budget = step_budget();
+	} else if (t_depth >= MAX_DEPTH || t_budget == 0) {
+		t_queue.push_back(node);
+		t_queued = true;
+		return;
+	}
+	t_depth++;
+	t_budget--;
+	destroy(node);
+	t_depth--;
+
+	if (t_depth == 0 && has_queued()) {
+		destroy_queued(t_budget);
+		if (has_queued()) {
+			CycleCollector::s_pending = t_current;
+		}
+	}
+}
+
+
+CycleCollector::CycleCollector() : m_previous(t_current) {
+	m_limit = s_threshold;
+	t_current = this;
+}
+
+CycleCollector::~CycleCollector() {
+	destroy_queued(SIZE_MAX);
+	collect();
+	destroy_queued(SIZE_MAX);
+	if (s_print_stats) {
+		print_stats();
+	}
+
+	for (const GCHeader* root : m_roots) {
+		if (root) {
+			root->set_gc_root(0);
+		}
+	}
+	if (s_pending == this) {
+		s_pending = nullptr;
+	}
+	// collectors are destroyed in the reverse order they were created
+	t_current = m_previous;
+}
+
+void CycleCollector::set_threshold(size_t threshold) {
+	s_threshold = threshold;
+}
+
+void CycleCollector::set_print_stats(bool print) {
+	s_print_stats = print;
+}
+
+void CycleCollector::set_free_budget(size_t budget) {
+	s_free_budget = budget;
+}
+
+
+void CycleCollector::add_root(const GCHeader* node) {
+	m_roots.push_back(node);
+	node->set_gc_root(m_roots.size());
+	m_root_count++;
+	if (m_roots.size() >= m_limit && !m_collecting) {
+		s_pending = this;
+	}
+}
+
+void CycleCollector::remove_root(const GCHeader* node) {
+	m_roots[node->gc_root() - 1] = nullptr;
+	node->set_gc_root(0);
+	m_root_count--;
+}
+
+void CycleCollector::compact_roots() {
+	size_t count = 0;
+	for (const GCHeader* root : m_roots) {
+		if (root) {
+			m_roots[count++] = root;
+			root->set_gc_root(count);
+		}
+	}
+	m_roots.resize(count);
+}
+
+void CycleCollector::collect_pending() {
+	s_pending = nullptr;
+	if (has_queued()) {
+		destroy_queued(step_budget());
+	}
+
+	if (m_roots.size() >= m_limit) {
+		// most of the buffered objects are usually freed already
+		compact_roots();
+		if (s_threshold != 0 && m_root_count >= m_limit / 2) {
+			const size_t freed = collect();
+			// the roots are still alive, wait for more before trying again
+			m_limit = freed ? s_threshold : m_limit * 2;
+		}
+		if (m_limit < m_root_count * 2) {
+			m_limit = m_root_count * 2;
+		}
+	}
+	if (has_queued()) {
+		s_pending = this;
+	}
+}
+
+size_t CycleCollector::collect() {
+	if (m_collecting) {
+		return 0;
+	}
+	m_collecting = true;
+	const auto start = std::chrono::steady_clock::now();
+	const size_t bytes = Pool::bytes_in_use();
+
+	std::vector<const GCHeader*> roots;
+	roots.swap(m_roots);
+	m_root_count = 0;
+	for (const GCHeader* root : roots) {
+		if (root) {
+			root->set_gc_root(0);
+		}
+	}
+
+	for (const GCHeader* root : roots) {
+		if (root) {
+			mark_gray(root);
+		}
+	}
+	for (const GCHeader* root : roots) {
+		if (root) {
+			scan(root);
+		}
+	}
+	for (const GCHeader* root : roots) {
+		if (root) {
+			collect_white(root);
+		}
+	}
+
+	const size_t freed = m_garbage.size();
+	free_garbage();
+
+	const double pause = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	const size_t bytes_after = Pool::bytes_in_use();
+	m_stats.collections++;
+	m_stats.freed_objects += freed;
+	m_stats.freed_bytes += bytes > bytes_after ? bytes - bytes_after : 0;
+	m_stats.total_pause_ms += pause;
+	if (pause > m_stats.max_pause_ms) {
+		m_stats.max_pause_ms = pause;
+	}
+
+	m_collecting = false;
+	return freed;
+}
+
+// subtracts the references from the objects reachable from the root
+void CycleCollector::mark_gray(const GCHeader* node) {
+	if (node->gc_color() == GCColor::GC_GRAY) {
+		return;
+	}
+	node->set_gc_color(GCColor::GC_GRAY);
+	m_stack.push_back(node);
+	while (!m_stack.empty()) {
+		const GCHeader* current = m_stack.back();
+		m_stack.pop_back();
+		trace(current, [this](const GCHeader* child) {
+			child->m_ref_count--;
+			if (child->gc_color() != GCColor::GC_GRAY) {
+				child->set_gc_color(GCColor::GC_GRAY);
+				m_stack.push_back(child);
+			}
+		});
+	}
+}
+
+// what still has references is alive and so is everything it reaches, the rest is garbage
+void CycleCollector::scan(const GCHeader* node) {
+	m_stack.push_back(node);
+	while (!m_stack.empty()) {
+		const GCHeader* current = m_stack.back();
+		m_stack.pop_back();
+		if (current->gc_color() != GCColor::GC_GRAY) {
+			continue;
+		}
+		if (current->m_ref_count > 0) {
+			scan_black(current);
+		} else {
+			current->set_gc_color(GCColor::GC_WHITE);
+			trace(current, [this](const GCHeader* child) {
+				m_stack.push_back(child);
+			});
+		}
+	}
+}
+
+// restores the references subtracted from the objects reachable from a live one
+void CycleCollector::scan_black(const GCHeader* node) {
+	node->set_gc_color(GCColor::GC_BLACK);
+	m_black_stack.push_back(node);
+	while (!m_black_stack.empty()) {
+		const GCHeader* current = m_black_stack.back();
+		m_black_stack.pop_back();
+		trace(current, [this](const GCHeader* child) {
+			child->m_ref_count++;
+			if (child->gc_color() != GCColor::GC_BLACK) {
+				child->set_gc_color(GCColor::GC_BLACK);
+				m_black_stack.push_back(child);
+			}
+		});
+	}
+}
+
+void CycleCollector::collect_white(const GCHeader* node) {
+	m_stack.push_back(node);
+	while (!m_stack.empty()) {
+		const GCHeader* current = m_stack.back();
+		m_stack.pop_back();
+		if (current->gc_color() != GCColor::GC_WHITE) {
+			continue;
+		}
+		current->set_gc_color(GCColor::GC_BLACK);
+		m_garbage.push_back(current);
+		trace(current, [this](const GCHeader* child) {
+			m_stack.push_back(child);
+		});
+	}
+}
+
+// the garbage objects get their references back so they can be released the usual way,
+// each is held while they all drop their references to each other, then let go
+void CycleCollector::free_garbage() {
+	for (const GCHeader* node : m_garbage) {
+		trace(node, [](const GCHeader* child) {
+			child->m_ref_count++;
+		});
+	}
+	for (const GCHeader* node : m_garbage) {
+		node->m_ref_count++;
+	}
+	for (const GCHeader* node : m_garbage) {
+		clear_references(node);
+	}
+	for (const GCHeader* node : m_garbage) {
+		if (--node->m_ref_count == 0) {
+			gc_release(node);
+		}
+	}
+	m_garbage.clear();
+}
+
+void CycleCollector::print_stats() const {
+	MN_PRINT_LN("gc: %llu collections, %llu objects freed, %llu bytes freed, pause %.3f ms total, %.3f ms max",
+		(unsigned long long)m_stats.collections, (unsigned long long)m_stats.freed_objects,
+		(unsigned long long)m_stats.freed_bytes, m_stats.total_pause_ms, m_stats.max_pause_ms);
+}
+
+}
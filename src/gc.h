@@ -0,0 +1,186 @@
+#pragma once
+
+#include "base.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace minik {
+
+// objects the cycle collector traverses, Value's heap cells of lists, callables, instances and namespaces
+// and the storage of lists are traversed too so a cycle can run through a variable or a list element
+enum class GCKind : uint8_t { NONE, OBJECT, ENVIRONMENT, CALLABLE, INSTANCE, NAMESPACE, LIST_CELL, CALLABLE_CELL, INSTANCE_CELL, NAMESPACE_CELL, LIST_BUFFER };
+
+// trial deletion colors. Prefixed, packages include headers that define BLACK or WHITE
+enum class GCColor : uint32_t { GC_BLACK = 0, GC_GRAY = 1, GC_WHITE = 2 };
+
+// reference count and collector state, kind in the low 4 bits, color in the next 2,
+// a flag left to the kind and the index + 1 of the object in the root buffer in the rest
+struct GCHeader {
+
+	mutable uint32_t m_ref_count = 0;
+	mutable uint32_t m_gc_info = 0;
+
+	GCHeader(GCKind kind = GCKind::NONE) : m_gc_info((uint32_t)kind) {}
+
+	GCKind gc_kind() const { return (GCKind)(m_gc_info & KIND_MASK); }
+	GCColor gc_color() const { return (GCColor)((m_gc_info >> COLOR_SHIFT) & 3); }
+	void set_gc_color(GCColor color) const { m_gc_info = (m_gc_info & ~COLOR_MASK) | ((uint32_t)color << COLOR_SHIFT); }
+	bool gc_flag() const { return m_gc_info & FLAG_MASK; }
+	void set_gc_flag() const { m_gc_info |= FLAG_MASK; }
+	uint32_t gc_root() const { return m_gc_info >> ROOT_SHIFT; }
+	void set_gc_root(uint32_t root) const { m_gc_info = (m_gc_info & ~ROOT_MASK) | (root << ROOT_SHIFT); }
+
+	static constexpr uint32_t KIND_MASK = 0xf;
+	static constexpr uint32_t COLOR_SHIFT = 4;
+	static constexpr uint32_t COLOR_MASK = 3 << COLOR_SHIFT;
+	static constexpr uint32_t FLAG_MASK = 1 << 6;
+	static constexpr uint32_t ROOT_SHIFT = 7;
+	static constexpr uint32_t ROOT_MASK = ~(KIND_MASK | COLOR_MASK | FLAG_MASK);
+};
+
+// enumerates the traced references of an object
+class GCTracer {
+public:
+	virtual ~GCTracer() = default;
+	virtual void visit(const GCHeader* child) = 0;
+
+	template<typename T>
+	void visit(const Ref<T>& ref) {
+		if (ref) {
+			visit(static_cast<const GCHeader*>(ref.get()));
+		}
+	}
+};
+
+// reference counted object the cycle collector can traverse, see Ref.
+// Copying an object doesn't copy its count or collector state
+class Collectable : public GCHeader {
+public:
+	Collectable(GCKind kind) : GCHeader(kind) {}
+	Collectable(const Collectable& other) : GCHeader(other.gc_kind()) {}
+	Collectable& operator=(const Collectable&) { return *this; }
+
+	void add_ref() const { ++m_ref_count; }
+	bool release_ref() const { return --m_ref_count == 0; }
+	uint32_t ref_count() const { return m_ref_count; }
+};
+
+// a reference dropped while others are left may have been the last one from outside
+// a cycle, the object is buffered as a possible root. Forgotten when it is freed
+void gc_possible_root(const GCHeader* node);
+void gc_forget_root(const GCHeader* node);
+
+// destroys a variable or a heap cell whose count dropped to zero, every reference that makes
+// a graph deep goes through one. What its destructor releases is destroyed recursively up to
+// a depth and a budget, the rest is queued and destroyed at the next safe points so neither
+// the stack nor the pause grows with the graph
+void gc_release(const GCHeader* node);
+
+// environments, callables and instances, every dropped reference makes them a possible root
+class CollectableRoot : public Collectable {
+public:
+	CollectableRoot(GCKind kind) : Collectable(kind) {}
+	CollectableRoot(const CollectableRoot& other) : Collectable(other) {}
+	CollectableRoot& operator=(const CollectableRoot&) { return *this; }
+	~CollectableRoot() {
+		if (gc_root() != 0) {
+			gc_forget_root(this);
+		}
+	}
+
+	bool release_ref() const {
+		if (--m_ref_count == 0) {
+			return true;
+		}
+		if (gc_root() == 0) {
+			gc_possible_root(this);
+		}
+		return false;
+	}
+};
+
+
+struct GCStats {
+	uint64_t collections = 0;
+	uint64_t freed_objects = 0;
+	uint64_t freed_bytes = 0;
+	double total_pause_ms = 0.0;
+	double max_pause_ms = 0.0;
+};
+
+// Synchronous trial deletion collector for reference cycles (Bacon and Rajan).
+// The possible roots are buffered, when there are enough of them the next safe point
+// subtracts the references between the objects reachable from them, what is left
+// without references from outside is a garbage cycle and is freed.
+// A collection runs to the end in one pause: trial deletion reads the reference counts,
+// so the script can't change them between its phases. The pause grows with the live graph
+// reachable from the buffered roots, not with the garbage found, see GCStats::max_pause_ms.
+// Every thread has a current collector, an Interpreter makes its own current while it lives
+// and collects one last time when it is destroyed.
+class CycleCollector {
+public:
+	CycleCollector();
+	~CycleCollector();
+	CycleCollector(const CycleCollector&) = delete;
+	CycleCollector& operator=(const CycleCollector&) = delete;
+
+	// called between statements and on loop back edges, where no object is half built.
+	// Collects or destroys queued objects when there is work pending
+	static void safe_point() {
+		if (s_pending) {
+			s_pending->collect_pending();
+		}
+	}
+
+	// returns the number of objects freed
+	size_t collect();
+
+	// possible roots buffered before a collection runs, 0 only collects when the collector is destroyed
+	static void set_threshold(size_t threshold);
+	// print the statistics of each collector when it is destroyed
+	static void set_print_stats(bool print);
+	// objects destroyed at once when the last reference to a large graph is dropped, 0 for no limit
+	static void set_free_budget(size_t budget);
+
+	const GCStats& stats() const { return m_stats; }
+	void print_stats() const;
+
+	static constexpr size_t DEFAULT_THRESHOLD = 10000;
+	static constexpr size_t DEFAULT_FREE_BUDGET = 10000;
+
+private:
+	void collect_pending();
+	void add_root(const GCHeader* node);
+	void remove_root(const GCHeader* node);
+	void compact_roots();
+
+	void mark_gray(const GCHeader* node);
+	void scan(const GCHeader* node);
+	void scan_black(const GCHeader* node);
+	void collect_white(const GCHeader* node);
+	void free_garbage();
+
+private:
+	std::vector<const GCHeader*> m_roots = {};
+	size_t m_root_count = 0;
+	// buffer size that makes the next safe point collect
+	size_t m_limit = DEFAULT_THRESHOLD;
+	std::vector<const GCHeader*> m_stack = {};
+	std::vector<const GCHeader*> m_black_stack = {};
+	std::vector<const GCHeader*> m_garbage = {};
+	bool m_collecting = false;
+
+	GCStats m_stats = {};
+	CycleCollector* m_previous = nullptr;
+
+	// the collector of this thread when its root buffer is full or objects wait
+	// to be destroyed, null otherwise
+	static thread_local CycleCollector* s_pending;
+
+friend void gc_possible_root(const GCHeader* node);
+friend void gc_forget_root(const GCHeader* node);
+friend void gc_release(const GCHeader* node);
+};
+
+}
@@ -20,11 +20,17 @@
 
 namespace minik {
 
-Interpreter::Interpreter() {
-	m_globals->define(Token(IDENTIFIER, "clock",  {}, 0), CreateRef<Object>( CreateRef<mcClock>() ));
-	m_globals->define(Token(IDENTIFIER, "assert", {}, 0), CreateRef<Object>( CreateRef<mcAssert>() ));
-	m_globals->define(Token(IDENTIFIER, "to_str", {}, 0), CreateRef<Object>( CreateRef<mcToString>() ));
-	m_globals->define(Token(IDENTIFIER, "print",  {}, 0), CreateRef<Object>( CreateRef<mcPrint>() ));
+Interpreter::Interpreter(Engine engine) {
+	m_defer_stack.reserve(DEFER_STACK_CAPACITY);
+
+	if (engine == Engine::VM) {
+		m_vm = CreateScope<VM>(*this);
+	}
+
+	m_globals->define(Token(IDENTIFIER, "clock",  0), CreateRef<Object>( CreateRef<mcClock>() ));
+	m_globals->define(Token(IDENTIFIER, "assert", 0), CreateRef<Object>( CreateRef<mcAssert>() ));
+	m_globals->define(Token(IDENTIFIER, "to_str", 0), CreateRef<Object>( CreateRef<mcToString>() ));
+	m_globals->define(Token(IDENTIFIER, "print",  0), CreateRef<Object>( CreateRef<mcPrint>() ));
 
 	RegisterPackage(CreateRef<RaylibPackage>());
 	RegisterPackage(CreateRef<MathPackage>());
@@ -36,25 +42,18 @@ void Interpreter::RegisterPackage(const Ref<Package>& package) {
 }
 
 
-void Interpreter::interpret(const std::vector<Ref<Statement>>& statements) {
+void Interpreter::interpret(const BlockStatement& program) {
 	try {
-		execute_block(statements, m_environment);
-	} catch (BreakException) {
-	} catch (ContinueException) {
-	} catch (GotoException) {
+		execute_block(program, m_environment);
 	} catch (InterpreterException e) {
 		report_runtime_error(e);
 	}
 }
 
-void Interpreter::resolve(const Expression& expression, int depth) {
-	m_locals[&expression] = depth;
-}
-
-Ref<Object> Interpreter::look_up_variable(const Token& name, const Expression& expression) {
-	if (m_environment->has(NAMESPACE_TOKEN.lexeme)) {
-		Ref<Object> ns = m_environment->get(NAMESPACE_TOKEN);
-		if (ns->is_namespace()) {
+Ref<Object> Interpreter::look_up_variable(const Token& name, const Binding& binding) {
+	if (binding.namespace_depth >= 0) {
+		const Ref<Object>& ns = m_environment->get_at(binding.namespace_depth, binding.namespace_slot);
+		if (ns && ns->is_namespace()) {
 			Ref<Object> result = ns->as_namespace()->get(name);
 			if (result) {
 				return result;
@@ -62,10 +61,14 @@ Ref<Object> Interpreter::look_up_variable(const Token& name, const Expression& e
 		}
 	}
 
-	auto it = m_locals.find(&expression);
-	if (it != m_locals.end()) {
-		int distance = it->second;
-		return m_environment->get_at(distance, name);
+	if (binding.slot >= 0) {
+		return m_environment->get_at(binding.depth, binding.slot);
+	}
+	if (binding.global >= 0) {
+		return m_globals->get_global(binding.global, name);
+	}
+	if (binding.depth >= 0) {
+		return m_environment->get_at(binding.depth, name);
 	}
 
 	return m_globals->get(name);
@@ -73,51 +76,68 @@ Ref<Object> Interpreter::look_up_variable(const Token& name, const Expression& e
 
 
 void Interpreter::visit(const LiteralExpression& e) {
-	m_result = CreateRef<Object>(e.value);
+	// literals are never lists, the value is shared like a constant
+	set_value(e.value->value);
 }
 
 void Interpreter::visit(const GroupingExpression& e) {
-	evaluate(e.expression);
+	e.expression->accept(*this);
 }
 void Interpreter::visit(const VariableExpression& e) {
-	m_result = look_up_variable(e.name, e);
+	m_result = look_up_variable(e.name, e.binding);
 }
 void Interpreter::visit(const AssignmentExpression& e) {
-	Ref<Object> value = evaluate(e.value);
+	Value value = evaluate_copy(e.value);
 	Ref<Object> var;
 
-	auto it = m_locals.find(&e);
-	if (it != m_locals.end()) {
-		int distance = it->second;
-		var = m_environment->get_at(distance, e.name);
-		var->value = value->value;
+	if (e.binding.slot >= 0) {
+		var = m_environment->get_at(e.binding.depth, e.binding.slot);
+	} else if (e.binding.global >= 0) {
+		var = m_globals->get_global(e.binding.global, e.name);
+	} else if (e.binding.depth >= 0) {
+		var = m_environment->get_at(e.binding.depth, e.name);
 	} else {
 		var = m_globals->get(e.name);
-		var->value = value->value;
 	}
+	var->value = std::move(value);
 
 	m_result = var;
 }
 void Interpreter::visit(const LogicalExpression& e) {
-	Ref<Object> left = evaluate(e.left);
+	Value left = evaluate_copy(e.left);
 
 	if (e.operator_token.type == OR) {
 		if (is_truthy(left)) {
-			m_result = CreateRef<Object>(left);
+			set_value(std::move(left));
 			return;
 		}
 	} else if (e.operator_token.type == AND) {
 		if (!is_truthy(left)) {
-			m_result = CreateRef<Object>(left);
+			set_value(std::move(left));
 			return;
 		}
 	}
 
-	m_result = CreateRef<Object>(evaluate(e.right));
+	set_value(evaluate_copy(e.right));
 }
 
-void Interpreter::visit(const CallExpression& e) {
-	Ref<Object> callee = evaluate(e.callee);
+// obj.method() invokes the method with the instance in self instead of binding it
+Ref<MinikCallable> Interpreter::evaluate_callee(const CallExpression& e, Ref<Object>& self) {
+	Ref<Object> callee;
+	if (e.callee->kind == ExpressionKind::GET) {
+		const GetExpression& get = static_cast<const GetExpression&>(*e.callee);
+		Ref<Object> object = evaluate(get.object);
+		if (object->is_instance()) {
+			const Ref<MinikInstance>& instance = object->as_instance();
+			if (Ref<MinikFunction> method = instance->find_method(get.name.lexeme, get.cache, e.method_cache)) {
+				self = CreateRef<Object>(instance);
+				return method;
+			}
+		}
+		callee = get_property(get, object);
+	} else {
+		callee = evaluate(e.callee);
+	}
 
 	if (!callee) {
 		m_result = nullptr;
@@ -128,47 +148,119 @@ void Interpreter::visit(const CallExpression& e) {
 		m_result = nullptr;
 		throw InterpreterException(e.paren, "Object is not callable.");
 	}
+	return callee->as_callable();
+}
 
-	std::vector<Ref<Object>> arguments;
-	arguments.reserve(e.arguments.size());
-	for (const Ref<Expression>& argument : e.arguments) {
-		Ref<Object> arg = evaluate(argument);
-		if (!arg) {
-			throw InterpreterException(e.paren, "Object is not callable.");
-			continue;
-		}
-		if (!arg->is_list()) {
-			// NOTE: we copy the variable here
-			arg = CreateRef<Object>(arg);
-		}
-		arguments.emplace_back(arg);
+void Interpreter::visit(const CallExpression& e) {
+	Ref<Object> self = nullptr;
+	const Ref<MinikCallable> function = evaluate_callee(e, self);
+	if (e.cached_compiled && function->id() == e.cached_callee) {
+		call_compiled(e, static_cast<MinikFunction&>(*function), self);
+		return;
 	}
 
-	const Ref<MinikCallable>& function = callee->as_callable();
+	Arguments& arguments = acquire_arguments();
+	try {
+		for (const Ref<Expression>& argument : e.arguments) {
+			argument->accept(*this);
+			if (m_is_value) {
+				// temporaries are already a copy
+				m_is_value = false;
+				arguments.emplace_back(CreateRef<Object>(std::move(m_value)));
+				continue;
+			}
+
+			Ref<Object> arg = m_result;
+			if (!arg) {
+				throw InterpreterException(e.paren, "Object is not callable.");
+			}
+			if (!arg->is_list()) {
+				// NOTE: we copy the variable here
+				arg = CreateRef<Object>(arg);
+			}
+			arguments.emplace_back(std::move(arg));
+		}
+
+		if (function->id() != e.cached_callee) {
+			const int arity = function->arity();
+			if (arity != -1 && (int)arguments.size() != arity) {
+				throw InterpreterException(e.paren, "Expected " +
+								 std::to_string(arity) + " arguments but got " +
+								 std::to_string(arguments.size()) + ".");
+			}
+			e.cached_callee = function->id();
+			e.cached_compiled = m_vm && m_vm->compile_callee(*function);
+		}
 
-	if (function->arity() != -1 && arguments.size() != function->arity()) {
-		throw InterpreterException(e.paren, "Expected " +
-						 std::to_string(function->arity()) + " arguments but got " +
-						 std::to_string(arguments.size()) + ".");
+		if (self) {
+			m_result = static_cast<MinikFunction*>(function.get())->invoke(*this, arguments, self);
+		} else {
+			m_result = function->call(*this, arguments);
+		}
+	} catch (AssertException) {
+		release_arguments();
+		throw InterpreterException(e.paren, "Assertion failed.");
+	} catch (...) {
+		release_arguments();
+		throw;
 	}
+	release_arguments();
+}
 
+// a call of a function the vm runs, no cell is made for the arguments and the result
+void Interpreter::call_compiled(const CallExpression& e, MinikFunction& function, const Ref<Object>& self) {
+	const size_t base = m_vm->begin_call();
+	Value result;
 	try {
-		m_result = function->call(*this, arguments);
+		for (const Ref<Expression>& argument : e.arguments) {
+			argument->accept(*this);
+			if (m_is_value) {
+				m_is_value = false;
+				m_vm->push_argument(e.paren, std::move(m_value));
+				continue;
+			}
+			if (!m_result) {
+				throw InterpreterException(e.paren, "Object is not callable.");
+			}
+			m_vm->push_argument(e.paren, m_result->value);
+		}
+		result = m_vm->call(function, *function.chunk(), base, self);
 	} catch (AssertException) {
+		m_vm->abort_call(base);
 		throw InterpreterException(e.paren, "Assertion failed.");
+	} catch (...) {
+		m_vm->abort_call(base);
+		throw;
+	}
+
+	if (result.is_none()) {
+		m_result = nullptr;
+	} else {
+		set_value(std::move(result));
+	}
+}
+
+// one argument buffer for each call being evaluated, their capacity is kept for the next calls
+Arguments& Interpreter::acquire_arguments() {
+	if (m_call_depth == m_arguments.size()) {
+		m_arguments.emplace_back();
 	}
+	return m_arguments[m_call_depth++];
+}
+void Interpreter::release_arguments() {
+	m_arguments[--m_call_depth].clear();
 }
 
 void Interpreter::visit(const GetExpression& e) {
-	Ref<Object> object = evaluate(e.object);
+	m_result = get_property(e, evaluate(e.object));
+}
+Ref<Object> Interpreter::get_property(const GetExpression& e, const Ref<Object>& object) {
 	if (object->is_instance()) {
-		m_result = object->as_instance()->get(e.name, object->as_instance());
-		return;
+		return object->as_instance()->get(e.name, object->as_instance(), e.cache);
 	}
 
 	if (object->is_namespace()) {
-		m_result = object->as_namespace()->get(e.name);
-		return;
+		return object->as_namespace()->get(e.name);
 	}
 
 
@@ -178,14 +270,14 @@ void Interpreter::visit(const SetExpression& e) {
 	Ref<Object> object = evaluate(e.object);
 
 	if (object->is_instance()) {
-		Ref<Object> var = CreateRef<Object>(evaluate(e.value));
-		object->as_instance()->set(e.name, var);
+		Ref<Object> var = CreateRef<Object>(evaluate_copy(e.value));
+		object->as_instance()->set(e.name, var, e.cache);
 		m_result = var;
 		return;
 	}
 	if (object->is_namespace()) {
 		Ref<Object> var = object->as_namespace()->get(e.name);
-		var->value = evaluate(e.value)->value;
+		var->value = evaluate_copy(e.value);
 		m_result = var;
 		return;
 	}
@@ -195,17 +287,17 @@ void Interpreter::visit(const SetExpression& e) {
 }
 
 void Interpreter::visit(const ThisExpression& e) {
-	m_result = look_up_variable(e.keyword, e);
+	m_result = look_up_variable(e.keyword, e.binding);
 }
 
 void Interpreter::visit(const SubscriptExpression& e) {
 	Ref<Object> object = evaluate(e.object);
-	Ref<Object> key = evaluate(e.key);
-	
-	if (!key->is_double()) {
+	Value key = evaluate_value(e.key);
+
+	if (!key.is_double()) {
 		throw InterpreterException(e.name, "List indices must be of type double.");
 	}
-	const double& index = key->as_double();
+	const double index = key.as_double();
 
 	if (object->is_list()) {
 		const List& list = object->as_list();
@@ -219,7 +311,7 @@ void Interpreter::visit(const SubscriptExpression& e) {
 		if (index < 0 || index >= str.size()) {
 			throw InterpreterException(e.name, "String index out of bounds. The index " + std::to_string(index) + " is outside the valid range of 0 to " + std::to_string(str.size() - 1) + ".");
 		}
-		m_result = CreateRef<Object>(str.substr(static_cast<size_t>(index),1));
+		set_value(Value::character(str[static_cast<size_t>(index)]));
 		return;
 	}
 
@@ -229,50 +321,53 @@ void Interpreter::visit(const SubscriptExpression& e) {
 void Interpreter::visit(const ArrayInitializerExpression& e) {
 	List list = {};
 	for (const auto& element : e.elements) {
-		list.push_back(CreateRef<Object>(evaluate(element)));
+		list.push_back(CreateRef<Object>(evaluate_copy(element)));
 	}
-	m_result = CreateRef<Object>(list);
+	set_value(std::move(list));
 }
 void Interpreter::visit(const ArrayInitSizeExpression& e) {
-	auto eval = evaluate(e.size);
-	if (!eval->is_double()) {
+	Value eval = evaluate_value(e.size);
+	if (!eval.is_double()) {
 		throw InterpreterException(e.paren, "Array size must be a number.");
 	}
-	size_t size = eval->as_double();
+	size_t size = eval.as_double();
 	List list = {};
 	list.reserve(size);
 	for (size_t i = 0; i < size; ++i) {
 		list.push_back(CreateRef<Object>(0.0));
 	}
-	m_result = CreateRef<Object>(list);
+	set_value(std::move(list));
 }
 
 void Interpreter::visit(const SetSubscriptExpression& e) {
 	Ref<Object> object = evaluate(e.object);
-	Ref<Object> index = evaluate(e.index);
-	Ref<Object> value = evaluate(e.value);
+	Value index = evaluate_value(e.index);
+	Value value = evaluate_copy(e.value);
 
-	if (!index->is_double()) {
+	if (!index.is_double()) {
 		throw InterpreterException(e.name, "List indices must be of type double.");
 	}
-	if (index->as_double() < 0) {
-		throw InterpreterException(e.name, "List index '"+std::to_string(index->as_double())+"' is out of bounds.");
+	if (index.as_double() < 0) {
+		throw InterpreterException(e.name, "List index '"+std::to_string(index.as_double())+"' is out of bounds.");
 	}
-	const size_t idx = static_cast<size_t>(index->as_double());
+	const size_t idx = static_cast<size_t>(index.as_double());
 
 	if (object->is_list()) {
 		if (idx >= object->as_list().size()) {
 			throw InterpreterException(e.name, "String index out of bounds. The index " + std::to_string(idx) + " is outside the valid range of 0 to " + std::to_string(object->as_list().size() - 1) + ".");
 		}
-		object->as_list().at(idx)->value = value->value;
+		object->as_list().at(idx)->value = std::move(value);
 		m_result = object;
 		return;
 	}
 
 	if (object->is_string()) {
-		std::string str = value->to_string();
+		std::string str = value.to_string();
 		if (str.size() > 0) {
-			object->as_string().at(idx) = str.at(0);
+			// strings are immutable, the variable, field or element gets the changed copy
+			std::string text = object->as_string();
+			text.at(idx) = str.at(0);
+			object->value = std::move(text);
 			m_result = object;
 			return;
 		}
@@ -283,8 +378,8 @@ void Interpreter::visit(const SetSubscriptExpression& e) {
 
 
 void Interpreter::visit(const FunctionStatement& s) {
-	Ref<MinikFunction> function = CreateRef<MinikFunction>(s, m_environment);
-	m_environment->define(s.name, CreateRef<Object>(function));
+	// the function was created when the block was entered
+	m_environment->define(s.name, nullptr);
 }
 
 void Interpreter::visit(const ReturnStatement& s) {
@@ -292,7 +387,8 @@ void Interpreter::visit(const ReturnStatement& s) {
 	if (s.value) {
 		value = evaluate(s.value);
 	}
-	throw ReturnException{value};
+	m_return_value = value;
+	m_completion = Completion::RETURN;
 }
 
 Ref<Object> Interpreter::create_class(const ClassStatement& s) {
@@ -310,7 +406,7 @@ Ref<Object> Interpreter::create_class(const ClassStatement& s) {
 		members[member->name.lexeme] = member;
 	}
 
-	result->value = CreateRef<MinikClass>(s.name.lexeme, methods, members, m_environment);
+	result->value = Ref<MinikCallable>(CreateRef<MinikClass>(s.name.lexeme, methods, members, m_environment));
 	return result;
 }
 
@@ -343,23 +439,37 @@ Ref<Object> Interpreter::create_namespace(const NamespaceStatement& statement) {
 	// but not for the dev.mn
 	// namespace probably needs its own environment, and resolver needs to reflect that
 
-	for (Ref<Statement> st : statement.body) {
-		Statement* sptr = st.get();
-		if (VariableStatement* s = dynamic_cast<VariableStatement*>(sptr)) {
-			execute(st);
-			new_namespace->fields[s->name.lexeme] = m_result;
-		} else if (FunctionStatement* s = dynamic_cast<FunctionStatement*>(sptr)) {
-// 			MN_LOG("creating field %s to %s", s->name.lexeme.c_str(), statement.name.lexeme.c_str());
-			Ref<Object> fn = CreateRef<Object>(CreateRef<MinikFunction>(*s, m_environment, false, result));
-			new_namespace->fields[s->name.lexeme] = fn;
-
-			m_environment->predefine(s->name, fn);
-		} else if (ClassStatement* s = dynamic_cast<ClassStatement*>(sptr)) {
-			new_namespace->fields[s->name.lexeme] = create_class(*s);
-		} else if (NamespaceStatement* s = dynamic_cast<NamespaceStatement*>(sptr)) {
-// 			MN_LOG("creating namespace %s to %s", s->name.lexeme.c_str(), statement.name.lexeme.c_str());
-// 			MN_LOG("	%s, in %s", m_namespace->name.c_str(), enclosing_namespace->name.c_str());
-			new_namespace->fields[s->name.lexeme] = create_namespace(*s);
+	for (const Ref<Statement>& st : statement.body) {
+		switch (st->kind) {
+			case StatementKind::VARIABLE: {
+				const VariableStatement* s = static_cast<VariableStatement*>(st.get());
+				execute(st);
+				new_namespace->fields[s->name.lexeme] = m_result;
+				break;
+			}
+			case StatementKind::FUNCTION: {
+				const FunctionStatement* s = static_cast<FunctionStatement*>(st.get());
+// 				MN_LOG("creating field %s to %s", s->name.lexeme.c_str(), statement.name.lexeme.c_str());
+				Ref<Object> fn = CreateRef<Object>(CreateRef<MinikFunction>(*s, m_environment, false, result));
+				new_namespace->fields[s->name.lexeme] = fn;
+
+				m_environment->predefine(s->name, fn);
+				break;
+			}
+			case StatementKind::CLASS: {
+				const ClassStatement* s = static_cast<ClassStatement*>(st.get());
+				new_namespace->fields[s->name.lexeme] = create_class(*s);
+				break;
+			}
+			case StatementKind::NAMESPACE: {
+				const NamespaceStatement* s = static_cast<NamespaceStatement*>(st.get());
+// 				MN_LOG("creating namespace %s to %s", s->name.lexeme.c_str(), statement.name.lexeme.c_str());
+// 				MN_LOG("	%s, in %s", m_namespace->name.c_str(), enclosing_namespace->name.c_str());
+				new_namespace->fields[s->name.lexeme] = create_namespace(*s);
+				break;
+			}
+			default:
+				break;
 		}
 	}
 
@@ -376,29 +486,31 @@ void Interpreter::visit(const NamespaceStatement& s) {
 }
 
 void Interpreter::visit(const UnaryExpression& e) {
-	Ref<Object> right = evaluate(e.right);
-
 	switch (e.operator_token.type) {
 		case BANG:
-			m_result = CreateRef<Object>(!is_truthy(e.operator_token, right));
+			set_value(!is_truthy(e.operator_token, evaluate_value(e.right)));
 			return;
-		case MINUS:
-			if (right->is_double()) {
-				m_result = CreateRef<Object>(-right->as_double());
+		case MINUS: {
+			Value right = evaluate_value(e.right);
+			if (right.is_double()) {
+				set_value(-right.as_double());
 				return;
 			}
-			throw InterpreterException(e.operator_token, *right.get(), "Invalid argument type to unary expression.");
+			throw InterpreterException(e.operator_token, Object(right), "Invalid argument type to unary expression.");
+		}
 		case PLUS_PLUS: {
+			Ref<Object> right = evaluate(e.right);
 			if (right->is_double()) {
-				right->as_double()++;
+				right->value = right->as_double() + 1.0;
 				m_result = right;
 				return;
 			}
 			throw InterpreterException(e.operator_token, *right.get(), "Invalid argument type to unary expression.");
 		}
 		case MINUS_MINUS: {
+			Ref<Object> right = evaluate(e.right);
 			if (right->is_double()) {
-				right->as_double()--;
+				right->value = right->as_double() - 1.0;
 				m_result = right;
 				return;
 			}
@@ -411,13 +523,13 @@ void Interpreter::visit(const UnaryExpression& e) {
 }
 
 void Interpreter::visit(const BinaryExpression& e) {
-	Ref<Object> left = evaluate(e.left);
-	Ref<Object> right = evaluate(e.right);
+	Value left = evaluate_value(e.left);
+	Value right = evaluate_value(e.right);
 
 
 	// string concatenation
-	if (e.operator_token.type == PLUS && left->is_string() && right->is_string()) {
-		m_result = CreateRef<Object>(left->as_string() + right->as_string());
+	if (e.operator_token.type == PLUS && left.is_string() && right.is_string()) {
+		set_value(left.as_string() + right.as_string());
 		return;
 	}
 
@@ -425,10 +537,10 @@ void Interpreter::visit(const BinaryExpression& e) {
 	// is equals
 	switch (e.operator_token.type) {
 		case EQUAL_EQUAL:
-			m_result = CreateRef<Object>(is_equal(e.operator_token, left, right));
+			set_value(is_equal(e.operator_token, left, right));
 			return;
 		case BANG_EQUAL:
-			m_result = CreateRef<Object>(!is_equal(e.operator_token, left, right));
+			set_value(!is_equal(e.operator_token, left, right));
 			return;
 		default:
 			break;
@@ -436,42 +548,42 @@ void Interpreter::visit(const BinaryExpression& e) {
 
 
 	// doubles
-	if (!left->is_double()) {
-		throw InterpreterException(e.operator_token, left, "Invalid operand to binary expression.");
+	if (!left.is_double()) {
+		throw InterpreterException(e.operator_token, Object(left), "Invalid operand to binary expression.");
 	}
-	if (!right->is_double()) {
-		throw InterpreterException(e.operator_token, right, "Invalid operand to binary expression.");
+	if (!right.is_double()) {
+		throw InterpreterException(e.operator_token, Object(right), "Invalid operand to binary expression.");
 	}
-	double l = left->as_double();
-	double r = right->as_double();
+	double l = left.as_double();
+	double r = right.as_double();
 
 	switch (e.operator_token.type) {
 		case PLUS:
-			m_result = CreateRef<Object>(l + r);
+			set_value(l + r);
 			return;
 		case MINUS:
-			m_result = CreateRef<Object>(l - r);
+			set_value(l - r);
 			return;
 		case STAR:
-			m_result = CreateRef<Object>(l * r);
+			set_value(l * r);
 			return;
 		case MOD:
-			m_result = CreateRef<Object>(double(int(l) % int(r)));
+			set_value(double(int(l) % int(r)));
 			return;
 		case SLASH:
-			m_result = CreateRef<Object>(l / r);
+			set_value(l / r);
 			return;
 		case GREATER:
-			m_result = CreateRef<Object>(l > r);
+			set_value(l > r);
 			return;
 		case GREATER_EQUAL:
-			m_result = CreateRef<Object>(l >= r);
+			set_value(l >= r);
 			return;
 		case LESS:
-			m_result = CreateRef<Object>(l < r);
+			set_value(l < r);
 			return;
 		case LESS_EQUAL:
-			m_result = CreateRef<Object>(l <= r);
+			set_value(l <= r);
 			return;
 		default:
 			return;
@@ -480,110 +592,174 @@ void Interpreter::visit(const BinaryExpression& e) {
 
 Ref<Object> Interpreter::evaluate(const Ref<Expression>& expression) {
 	expression->accept(*this);
+	if (m_is_value) {
+		m_is_value = false;
+		m_result = CreateRef<Object>(std::move(m_value));
+	}
 	return m_result;
 }
 
-bool Interpreter::is_truthy(const Token& token, const Ref<Object>& object) const {
-	if (object->is_nil()) {
+Value Interpreter::evaluate_value(const Ref<Expression>& expression) {
+	expression->accept(*this);
+	if (m_is_value) {
+		m_is_value = false;
+		return std::move(m_value);
+	}
+	return m_result ? m_result->value : Value();
+}
+
+// a cell of its own for a new variable or field, a list read from a cell is copied like in an assignment
+Ref<Object> Interpreter::evaluate_cell(const Ref<Expression>& expression) {
+	expression->accept(*this);
+	if (m_is_value) {
+		m_is_value = false;
+		return CreateRef<Object>(std::move(m_value));
+	}
+	return m_result ? CreateRef<Object>(m_result->value.clone()) : nullptr;
+}
+
+// like evaluate_value, but lists read from a cell are copied
+Value Interpreter::evaluate_copy(const Ref<Expression>& expression) {
+	expression->accept(*this);
+	if (m_is_value) {
+		m_is_value = false;
+		return std::move(m_value);
+	}
+	return m_result ? m_result->value.clone() : Value();
+}
+
+void Interpreter::set_value(Value value) {
+	m_value = std::move(value);
+	m_result = nullptr;
+	m_is_value = true;
+}
+
+bool Interpreter::is_truthy(const Token& token, const Value& value) const {
+	if (value.is_nil()) {
 		return false;
 	}
-	if (object->is_bool()) {
-		return object->as_bool();
+	if (value.is_bool()) {
+		return value.as_bool();
 	}
-	if (object->is_double()) {
-		return object->as_double() != 0.0;
+	if (value.is_double()) {
+		return value.as_double() != 0.0;
 	}
 
-	throw InterpreterException(token, object, "No viable conversion to bool.");
+	throw InterpreterException(token, Object(value), "No viable conversion to bool.");
 }
-bool Interpreter::is_truthy(const Ref<Object>& object) const {
-	if (object->is_nil()) {
+bool Interpreter::is_truthy(const Value& value) const {
+	if (value.is_nil()) {
 		return false;
 	}
-	if (object->is_bool()) {
-		return object->as_bool();
+	if (value.is_bool()) {
+		return value.as_bool();
 	}
-	if (object->is_double()) {
-		return object->as_double() != 0.0;
+	if (value.is_double()) {
+		return value.as_double() != 0.0;
 	}
 	// TODO: throw exception ?
 	return false;
 }
 
-bool Interpreter::is_equal(const Token& token, const Ref<Object>& a, const Ref<Object>& b) const {
-	if (a->is_string() != b->is_string()) {
-		throw InterpreterException(token, a->is_string() ? a : b, "Cannot compare a string with a non-string type.");
+bool Interpreter::is_equal(const Token& token, const Value& a, const Value& b) const {
+	if (a.is_string() != b.is_string()) {
+		throw InterpreterException(token, Object(a.is_string() ? a : b), "Cannot compare a string with a non-string type.");
 	}
-	return a->equals(b);
+	return a.equals(b);
 }
 
 void Interpreter::visit(const ExpressionStatement& s) {
-	evaluate(s.expression);
+	evaluate_value(s.expression);
 }
 
 void Interpreter::visit(const VariableStatement& s) {
 	Ref<Object> value;
 	if (s.initializer) {
-		value = evaluate(s.initializer);
+		value = evaluate_cell(s.initializer);
 	}
 
-	m_environment->define(s.name, value);
+	if (s.slot >= 0) {
+		m_environment->define(s.slot, value);
+	} else {
+		m_environment->define(s.name, value);
+	}
+	// a namespace makes the cell one of its fields
+	m_result = std::move(value);
 }
 
 void Interpreter::visit(const BlockStatement& s) {
-	execute_block(s.statements, CreateRef<Environment>(m_environment), s.deferred_statements);
+	execute_block(s, block_environment(s));
 }
 
 void Interpreter::visit(const IfStatement& s) {
-	if (is_truthy(evaluate(s.condition))) {
-		execute_block(s.then_branch->statements, CreateRef<Environment>(m_environment), s.then_branch->deferred_statements);
+	if (is_truthy(evaluate_value(s.condition))) {
+		execute_block(*s.then_branch, block_environment(*s.then_branch));
 	} else if (s.else_branch) {
-		execute_block(s.else_branch->statements, CreateRef<Environment>(m_environment), s.else_branch->deferred_statements);
+		execute_block(*s.else_branch, block_environment(*s.else_branch));
 	}
 }
 
+// blocks that declare nothing run in the environment of the enclosing scope
+Ref<Environment> Interpreter::block_environment(const BlockStatement& block) const {
+	if (!block.scoped) {
+		return m_environment;
+	}
+	return CreateRef<Environment>(m_environment, block.slot_count);
+}
+
 void Interpreter::visit(const LabelStatement& s) {
 	if (s.loop) {
 		execute(s.loop);
 	}
 }
 void Interpreter::visit(const GotoStatement& s) {
-	throw GotoException{s.label};
+	m_completion = Completion::GOTO;
+	m_goto_depth = s.depth;
+	m_goto_index = s.index;
 }
 
 void Interpreter::visit(const ForStatement& s) {
-	const Ref<Environment>& loop_environment = CreateRef<Environment>(m_environment);
+	if (m_vm && m_vm->run_loop(s, m_environment)) {
+		return;
+	}
+
 	const Ref<Environment> previous = m_environment;
+	if (s.scoped) {
+		m_environment = CreateRef<Environment>(m_environment, s.slot_count);
+	}
 	try {
-		m_environment = loop_environment;
+		if (s.initializer) {
+			execute(s.initializer);
+		}
+
+		Ref<Environment> body_environment = nullptr;
+		while (is_truthy(evaluate_value(s.condition))) {
+			if (!s.body->scoped) {
+				body_environment = m_environment;
+			} else if (body_environment && body_environment.use_count() == 1) {
+				// nothing kept the environment of the last iteration, reuse it
+				body_environment->reset();
+			} else {
+				body_environment = CreateRef<Environment>(m_environment, s.body->slot_count);
+			}
+			execute_block(*s.body, body_environment);
 
-		try {
-			if (s.initializer) {
-				execute(s.initializer);
+			if (m_completion == Completion::CONTINUE && targets_loop(s)) {
+				// continue ends execution of the block, jumping to the increment
+				m_completion = Completion::NORMAL;
 			}
-			while (is_truthy(evaluate(s.condition))) {
-				try {
-					execute_block(s.body->statements, CreateRef<Environment>(m_environment), s.body->deferred_statements);
-				} catch (ContinueException c) {
-					// handles continue by ending execution of the block, jumping to the increment
-					if (c.label.type == IDENTIFIER) {
-						if (!s.label || s.label->name.lexeme != c.label.lexeme) {
-							throw c;
-						}
-					}
-				}
-				if (s.increment) {
-					evaluate(s.increment);
-				}
-				// clear deferred statements before next iteration
-				s.body->deferred_statements.clear();
+			if (m_completion == Completion::BREAK && targets_loop(s)) {
+				// break stops execution of the loop
+				m_completion = Completion::NORMAL;
+				break;
 			}
-		} catch (BreakException b) {
-			// handles break by stopping execution of the loop
-			if (b.label.type == IDENTIFIER) {
-				if (!s.label || s.label->name.lexeme != b.label.lexeme) {
-					throw b;
-				}
+			if (m_completion != Completion::NORMAL) {
+				// a return or a labeled break/continue of an outer loop
+				break;
+			}
+
+			if (s.increment) {
+				evaluate_value(s.increment);
 			}
 		}
 
@@ -595,59 +771,70 @@ void Interpreter::visit(const ForStatement& s) {
 }
 
 void Interpreter::visit(const BreakStatement& s) {
-	throw BreakException{s.keyword};
+	m_completion = Completion::BREAK;
+	m_completion_label = &s.keyword;
 }
 void Interpreter::visit(const ContinueStatement& s) {
-	throw ContinueException{s.keyword};
+	m_completion = Completion::CONTINUE;
+	m_completion_label = &s.keyword;
+}
+
+// an unlabeled break/continue targets the innermost loop
+bool Interpreter::targets_loop(const ForStatement& s) const {
+	if (m_completion_label->type != IDENTIFIER) {
+		return true;
+	}
+	return s.label && s.label->name.lexeme == m_completion_label->lexeme;
 }
 
 void Interpreter::execute(const Ref<Statement>& statement) {
+	CycleCollector::safe_point();
 	statement->accept(*this);
 }
 
-void Interpreter::execute_block(const std::vector<Ref<Statement>>& statements, const Ref<Environment>& environment, const std::vector<Ref<Statement>>& deferred_statements) {
+void Interpreter::execute_block(const BlockStatement& block, const Ref<Environment>& environment) {
+	const std::vector<Ref<Statement>>& statements = block.statements;
 	const Ref<Environment> previous = m_environment;
 	m_environment = environment;
+	const size_t defer_base = m_defer_stack.size();
 
 	const auto exit_block = [&]() {
 		//exit block
-		if (deferred_statements.size() > 0) {
-			for (auto it = deferred_statements.rbegin(); it != deferred_statements.rend(); ++it) {
-				execute(*it);
+		if (m_defer_stack.size() > defer_base) {
+			// deferred statements run even if the block is left by a return, break or continue
+			const Completion completion = m_completion;
+			m_completion = Completion::NORMAL;
+			while (m_defer_stack.size() > defer_base) {
+				Statement* deferred = m_defer_stack.back();
+				m_defer_stack.pop_back();
+				deferred->accept(*this);
+			}
+			if (m_completion == Completion::NORMAL) {
+				m_completion = completion;
 			}
 		}
+		if (m_completion == Completion::GOTO) {
+			m_goto_depth--;
+		}
 		m_environment = previous;
 	};
 
-	collect_predefinitions(statements);
+	if (!block.hoisted.empty()) {
+		collect_predefinitions(block.hoisted);
+	}
 
 	try {
-		size_t start_index = 0;
-		while (start_index < statements.size()) {
-			m_environment = environment;
-			try {
-				for (size_t i = start_index; i < statements.size(); ++i) {
-					execute(statements[i]);
-				}
+		size_t i = 0;
+		while (i < statements.size()) {
+			execute(statements[i]);
+			if (m_completion == Completion::NORMAL) {
+				++i;
+			} else if (m_completion == Completion::GOTO && m_goto_depth == 0) {
+				// the label is in this block, the resolver found its index
+				m_completion = Completion::NORMAL;
+				i = m_goto_index;
+			} else {
 				break;
-			} catch (GotoException e) {
-				bool found_label = false;
-
-				for (size_t i = 0; i < statements.size(); ++i) {
-					if (LabelStatement* l = dynamic_cast<LabelStatement*>(statements[i].get())) {
-						if (l->name.lexeme == e.label.lexeme) {
-							start_index = i;
-							found_label = true;
-							break;
-						}
-					}
-				}
-
-				if (!found_label) {
-					// should we ?
-					exit_block();
-					throw e; // re-throw the GotoException if label not found in this block
-				}
 			}
 		}
 
@@ -661,33 +848,45 @@ void Interpreter::execute_block(const std::vector<Ref<Statement>>& statements, c
 
 
 void Interpreter::collect_predefinition(Statement* s) {
-	if (FunctionStatement* statement = dynamic_cast<FunctionStatement*>(s)) {
-		Ref<MinikFunction> function = CreateRef<MinikFunction>(*statement, m_environment);
-		m_environment->predefine(statement->name, CreateRef<Object>(function));
-	} else if (ClassStatement* statement = dynamic_cast<ClassStatement*>(s)) {
-		m_environment->predefine(statement->name, create_class(*statement));
-	} else if (NamespaceStatement* statement = dynamic_cast<NamespaceStatement*>(s)) {
-		Ref<Object> new_ns = create_namespace(*statement);
-		m_environment->predefine(statement->name, new_ns);
-	} else if (ImportStatement* statement = dynamic_cast<ImportStatement*>(s)) {
-		visit(*statement);
+	switch (s->kind) {
+		case StatementKind::FUNCTION: {
+			const FunctionStatement* statement = static_cast<FunctionStatement*>(s);
+			Ref<MinikFunction> function = CreateRef<MinikFunction>(*statement, m_environment);
+			m_environment->predefine(statement->name, CreateRef<Object>(function));
+			break;
+		}
+		case StatementKind::CLASS: {
+			const ClassStatement* statement = static_cast<ClassStatement*>(s);
+			m_environment->predefine(statement->name, create_class(*statement));
+			break;
+		}
+		case StatementKind::NAMESPACE: {
+			const NamespaceStatement* statement = static_cast<NamespaceStatement*>(s);
+			Ref<Object> new_ns = create_namespace(*statement);
+			m_environment->predefine(statement->name, new_ns);
+			break;
+		}
+		case StatementKind::IMPORT:
+			visit(*static_cast<ImportStatement*>(s));
+			break;
+		default:
+			break;
 	}
 }
-void Interpreter::collect_predefinitions(const std::vector<Ref<Statement>>& statements) {
-	for (auto& s : statements) {
-		collect_predefinition(s.get());
+void Interpreter::collect_predefinitions(const std::vector<Statement*>& hoisted) {
+	for (Statement* s : hoisted) {
+		collect_predefinition(s);
 	}
 }
 
 void Interpreter::visit(const DeferStatement& s) {
-	s.enclosing_block->deferred_statements.push_back(s.statement);
+	m_defer_stack.push_back(s.statement.get());
 }
 
 void Interpreter::visit(const ImportStatement& s) {
 	if (s.is_file) {
-		Resolver resolver = Resolver(*this);
-		resolver.resolve_block(s.statements);
-		collect_predefinitions(s.statements);
+		Resolver resolver = Resolver(*this, m_environment == m_globals);
+		collect_predefinitions(resolver.resolve_block(s.statements));
 // 		execute_block(statements, m_environment);
 	} else {
 		auto p = m_packages.find(s.name.lexeme);
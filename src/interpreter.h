@@ -3,20 +3,28 @@
 #include "callable.h"
 #include "class.h"
 #include "function.h"
+#include "gc.h"
 #include "environment.h"
 #include "expression.h"
 #include "minik.h"
 #include "object.h"
 #include "package.h"
+#include "pool.h"
 #include "statement.h"
+#include "vm.h"
+#include <deque>
 #include <unordered_map>
 #include <vector>
 
 namespace minik {
 
+// how the last statement completed, the enclosing blocks skip the rest of
+// their statements until a loop or function call handles it
+enum class Completion { NORMAL, RETURN, BREAK, CONTINUE, GOTO };
+
 class Interpreter : public Visitor {
 public:
-	Interpreter();
+	Interpreter(Engine engine = Engine::TREE);
 
 	void RegisterPackage(const Ref<Package>& package);
 
@@ -52,38 +60,80 @@ public:
 	virtual void visit(const GotoStatement& s)       override;
 	virtual void visit(const ImportStatement& s)     override;
 
-	void interpret(const std::vector<Ref<Statement>>& statements);
-
-	void resolve(const Expression& expression, int depth);
+	void interpret(const BlockStatement& program);
 
 private:
-	Ref<Object> look_up_variable(const Token& name, const Expression& expression);
+	Ref<Object> look_up_variable(const Token& name, const Binding& binding);
 
 	Ref<Object> evaluate(const Ref<Expression>& expression);
-	bool is_equal(const Token& token, const Ref<Object>& a, const Ref<Object>& b) const;
-	bool is_truthy(const Token& token, const Ref<Object>& object) const;
-	bool is_truthy(const Ref<Object>& object) const;
+	Value evaluate_value(const Ref<Expression>& expression);
+	Value evaluate_copy(const Ref<Expression>& expression);
+	Ref<Object> evaluate_cell(const Ref<Expression>& expression);
+	void set_value(Value value);
+	bool is_equal(const Token& token, const Value& a, const Value& b) const;
+	bool is_truthy(const Token& token, const Value& value) const;
+	bool is_truthy(const Value& value) const;
 	void execute(const Ref<Statement>& statement);
-	void execute_block(const std::vector<Ref<Statement>>& statements, const Ref<Environment>& environment, const std::vector<Ref<Statement>>& deferred_statements = {});
-
+	bool targets_loop(const ForStatement& s) const;
+	void execute_block(const BlockStatement& block, const Ref<Environment>& environment);
+
+	Ref<Environment> block_environment(const BlockStatement& block) const;
+	Ref<MinikCallable> evaluate_callee(const CallExpression& e, Ref<Object>& self);
+	Ref<Object> get_property(const GetExpression& e, const Ref<Object>& object);
+	void call_compiled(const CallExpression& e, MinikFunction& function, const Ref<Object>& self);
+	Arguments& acquire_arguments();
+	void release_arguments();
 	void collect_predefinition(Statement* s);
-	void collect_predefinitions(const std::vector<Ref<Statement>>& statements);
+	void collect_predefinitions(const std::vector<Statement*>& hoisted);
 
 
 	Ref<Object> create_class(const ClassStatement& s);
 	Ref<Object> create_namespace(const NamespaceStatement& statement);
 
 private:
+	// runtime objects of this interpreter, declared first so it outlives all of them
+	Pool m_pool;
+	// frees the reference cycles, collects the ones left when the other members are gone
+	CycleCollector m_collector;
+
 	Ref<Environment> m_globals = CreateRef<Environment>();
 	Ref<Environment> m_environment = m_globals;
 	Ref<MinikNamespace> m_namespace = CreateRef<MinikNamespace>("GLOBAL", nullptr);
-	std::unordered_map<const Expression*, int> m_locals = {};
+	// result of the last expression, the cell it was read from in m_result,
+	// or a temporary in m_value when m_is_value is set
 	Ref<Object> m_result = nullptr;
+	Value m_value = {};
+	bool m_is_value = false;
+
+	Completion m_completion = Completion::NORMAL;
+	// keyword of the last break/continue, an identifier when it is labeled
+	const Token* m_completion_label = nullptr;
+	Ref<Object> m_return_value = nullptr;
+	// blocks left to exit before the goto target block, and the index of the label in it
+	int m_goto_depth = 0;
+	size_t m_goto_index = 0;
+
+	// statements deferred by the blocks being executed, each block runs
+	// and pops the ones above the size the stack had when it was entered.
+	// reserved once, so it only allocates for deeply nested defers
+	std::vector<Statement*> m_defer_stack = {};
+	static constexpr size_t DEFER_STACK_CAPACITY = 64;
+
+	// argument buffers of the calls being evaluated, by call depth.
+	// a deque so a nested call can add one without moving the others
+	std::deque<Arguments> m_arguments = {};
+	size_t m_call_depth = 0;
 
 	std::unordered_map<std::string, Ref<Package>> m_packages;
+
+	// compiles and runs function bodies when the vm engine is selected
+	Scope<VM> m_vm = nullptr;
 friend MinikFunction;
 friend MinikCallable;
 friend MinikClass;
+friend class Compiler;
+friend class VM;
+friend class Resolver;
 };
 
 }
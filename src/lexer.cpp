@@ -6,7 +6,7 @@
 
 namespace minik {
 
-const std::map<std::string, TokenType> Lexer::keywords = {
+const std::map<std::string, TokenType, std::less<>> Lexer::keywords = {
 	{"and",    AND},
 	{"break",  BREAK},
 	{"class",  CLASS},
@@ -32,15 +32,16 @@ const std::map<std::string, TokenType> Lexer::keywords = {
 };
 
 
-std::vector<Token>& Lexer::scan_tokens() {
+std::vector<SourceToken> Lexer::scan_tokens() {
 	while (!is_at_end()) {
 		m_start = m_current;
 		scan_token();
 	}
 
-	m_tokens.emplace_back(MEOF, "", CreateRef<Object>(nullptr), m_line);
+	m_start = m_current;
+	add_token(MEOF);
 
-	return m_tokens;
+	return std::move(m_tokens);
 }
 
 
@@ -109,29 +110,25 @@ bool Lexer::is_at_end() const {
 	return m_current >= m_source.length();
 }
 char Lexer::advance() {
-	return m_source.at(m_current++);
+	return m_source[m_current++];
 }
 void Lexer::add_token(TokenType type) {
-	add_token(type, nullptr);
-}
-void Lexer::add_token(TokenType type, Object literal) {
-	std::string text = substr(m_start, m_current);
-	m_tokens.emplace_back(type, text, CreateRef<Object>(literal), m_line);
+	m_tokens.push_back(SourceToken{type, m_line, m_start, m_current - m_start});
 }
 
 bool Lexer::match(char expected) {
 	if (is_at_end()) { return false; }
-	if (m_source.at(m_current) != expected) { return false; }
+	if (m_source[m_current] != expected) { return false; }
 	m_current++;
 	return true;
 }
 char Lexer::peek() const {
 	if (is_at_end()) { return '\0'; }
-	return m_source.at(m_current);
+	return m_source[m_current];
 }
 char Lexer::peek_next() const {
 	if (m_current + 1 >= m_source.length()) { return '\0'; }
-	return m_source.at(m_current + 1);
+	return m_source[m_current + 1];
 }
 
 
@@ -151,9 +148,8 @@ void Lexer::string() {
 	// closing "
 	advance();
 
-	// trim the surrounding quotes
-	std::string value = substr(m_start + 1, m_current - 1);
-	add_token(STRING, {value});
+	// the parser decodes the literal
+	add_token(STRING);
 }
 
 
@@ -175,7 +171,7 @@ void Lexer::number() {
 		}
 	}
 
-	add_token(NUMBER, { std::stod(substr(m_start, m_current)) });
+	add_token(NUMBER);
 }
 
 
@@ -188,11 +184,12 @@ void Lexer::identifier() {
 		advance();
 	}
 
-	std::string text = substr(m_start, m_current);
+	std::string_view text = m_source.substr(m_start, m_current - m_start);
 
 	TokenType type = IDENTIFIER;
-	if (keywords.find(text) != keywords.end()) {
-		type = keywords.at(text);
+	auto keyword = keywords.find(text);
+	if (keyword != keywords.end()) {
+		type = keyword->second;
 	}
 
 	add_token(type);
@@ -202,9 +199,7 @@ bool Lexer::is_alpha_numeric(char c) const {
 	return is_alpha(c) || is_digit(c);
 }
 
-std::string Lexer::substr(int start, int end) const {
-	return m_source.substr(start, (end-start));
-}
+
 
 
 }
@@ -1,25 +1,26 @@
 #pragma once
 #include "base.h"
 #include "token.h"
-#include <vector>
 #include <map>
+#include <string_view>
+#include <vector>
 
 
 namespace minik {
 
 
+// Splits the source into SourceTokens, which point into it instead of copying their text.
 class Lexer {
 public:
-	Lexer(std::string source)
+	Lexer(std::string_view source)
 		: m_source(source) {}
 
-	std::vector<Token>& scan_tokens();
+	std::vector<SourceToken> scan_tokens();
 
 private:
 	bool is_at_end() const;
 	char advance();
 	void add_token(TokenType type);
-	void add_token(TokenType type, Object literal);
 
 	void scan_token();
 
@@ -37,18 +38,16 @@ private:
 
 	bool is_alpha_numeric(char c) const;
 
-	inline std::string substr(int start, int end) const;
-
 private:
-	std::string m_source;
-	std::vector<Token> m_tokens = {};
+	std::string_view m_source;
+	std::vector<SourceToken> m_tokens = {};
 
-	static const std::map<std::string, TokenType> keywords;
+	static const std::map<std::string, TokenType, std::less<>> keywords;
 
 
-	int m_start = 0;
-	int m_current = 0;
-	int m_line = 1;
+	uint32_t m_start = 0;
+	uint32_t m_current = 0;
+	uint32_t m_line = 1;
 
 };
 
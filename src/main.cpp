@@ -4,19 +4,42 @@
 
 
 int main(int argc, char* argv[]) {
-	if (argc > 1 && std::string(argv[1]) == "--run-tests") {
+	bool run_tests = false;
+	std::string script;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "--run-tests") {
+			run_tests = true;
+		} else if (arg == "--engine=tree") {
+			minik::set_engine(minik::Engine::TREE);
+		} else if (arg == "--engine=vm") {
+			minik::set_engine(minik::Engine::VM);
+		} else if (arg == "--pool-stats") {
+			minik::set_pool_stats(true);
+		} else if (arg == "--gc-stats") {
+			minik::set_gc_stats(true);
+		} else if (arg.rfind("--gc-threshold=", 0) == 0) {
+			minik::set_gc_threshold(std::stoul(arg.substr(15)));
+		} else if (arg.rfind("--free-budget=", 0) == 0) {
+			minik::set_free_budget(std::stoul(arg.substr(14)));
+		} else if (script.empty() && arg.rfind("--", 0) != 0) {
+			script = arg;
+		} else {
+			MN_ERROR("Usage: %s [--engine=tree|vm] [--pool-stats] [--gc-stats] [--gc-threshold=N] [--free-budget=N] [script.mn] or %s [--engine=tree|vm] --run-tests", argv[0], argv[0]);
+			return 64;
+		}
+	}
+
+	if (run_tests) {
 		Tester tester = Tester("../tests/");
 		tester.run_all_tests();
 		return 0;
 	}
 
-	if (argc > 2) {
-		MN_ERROR("Usage: %s [script.mn] or %s --run-tests", argv[0], argv[0]);
-		return 64;
-	} else if (argc == 2) {
-		minik::run_file(argv[1]);
+	if (!script.empty()) {
+		minik::run_file(script);
 	} else {
 		minik::run_prompt();
 	}
 }
-
@@ -1,63 +1,77 @@
 #include "minik.h"
 #include "exception.h"
+#include "gc.h"
 #include "interpreter.h"
 #include "lexer.h"
 #include "parser.h"
+#include "pool.h"
 #include "ast_printer.cpp"
 #include "resolver.h"
+#include "source_file.h"
 #include "statement.h"
 
 #include <cstdlib>
-#include <fstream>
 #include <string>
 
 namespace minik {
 
 static bool had_error = false;
 static bool had_runtime_error = false;
+static Engine engine = Engine::TREE;
 
+void set_engine(Engine e) {
+	engine = e;
+}
 
-void run(const std::string& source) {
-	Interpreter interpreter;
+void set_pool_stats(bool enabled) {
+	Pool::set_print_stats(enabled);
+}
 
-	Lexer lexer = Lexer(source);
-	std::vector<Token>& tokens = lexer.scan_tokens();
+void set_gc_threshold(size_t threshold) {
+	CycleCollector::set_threshold(threshold);
+}
 
-	Parser parser = Parser(tokens);
-	std::vector<Ref<Statement>> statements = parser.parse();
+void set_gc_stats(bool enabled) {
+	CycleCollector::set_print_stats(enabled);
+}
+
+void set_free_budget(size_t budget) {
+	CycleCollector::set_free_budget(budget);
+}
+
+
+void run(std::string_view source) {
+	Interpreter interpreter = Interpreter(engine);
+
+	Lexer lexer = Lexer(source);
+	Parser parser = Parser(source, lexer.scan_tokens());
+	BlockStatement program = BlockStatement(parser.parse());
 
 	if (had_error) {
 		return;
 	}
 
 	Resolver resolver = Resolver(interpreter);
-	resolver.resolve_block(statements);
+	program.hoisted = resolver.resolve_block(program.statements);
 
 	if (had_error) {
 		return;
 	}
 
-	interpreter.interpret(statements);
+	interpreter.interpret(program);
 }
 
 void run_file(const std::string& filename) {
-	std::ifstream file(filename);
+	SourceFile file(filename);
 	if (!file.is_open()) {
 		MN_ERROR("Could not open file %s", filename.c_str());
 		return;
 	}
 
-	Interpreter interpreter = Interpreter();
-
-	std::string source = std::string(
-		(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()
-	);
-	run(source);
+	run(file.text());
 
 	had_error = false;
 	had_runtime_error = false;
-
-	file.close();
 }
 
 
@@ -1,9 +1,22 @@
 #pragma once
 #include "base.h"
+#include <string_view>
 
 namespace minik {
 
-void run(const std::string& source);
+enum class Engine { TREE, VM };
+
+void set_engine(Engine engine);
+// print allocation statistics of the runtime objects after each run
+void set_pool_stats(bool enabled);
+// possible roots buffered before the cycle collector runs, 0 only collects at the end of a run
+void set_gc_threshold(size_t threshold);
+// print the cycle collector statistics after each run
+void set_gc_stats(bool enabled);
+// objects destroyed at once when a large graph is dropped, the rest at the next statements, 0 for no limit
+void set_free_budget(size_t budget);
+
+void run(std::string_view source);
 void run_file(const std::string& filename);
 void run_prompt();
 void report_error(int line, const std::string& message);
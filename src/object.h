@@ -4,118 +4,76 @@
 #include "callable.h"
 #include "class.h"
 #include "minik.h"
+#include "pool.h"
+#include "value.h"
 #include <cstddef>
 #include <exception>
-#include <variant>
 
 namespace minik {
 
-using List = std::vector<Ref<Object>>;
-using Value = std::variant<std::nullptr_t, bool, double, std::string, Ref<MinikCallable>, Ref<MinikInstance>, List, Ref<MinikNamespace>>;
+// mutable storage cell for a Value, variables, fields and list elements are Objects
+struct Object : public Collectable, public Pooled<PoolType::OBJECT> {
+	Value value = {};
 
-struct Object {
-	Value value = {nullptr};
+	Object() : Collectable(GCKind::OBJECT), value(nullptr) {}
+	Object(void*) : Collectable(GCKind::OBJECT), value(nullptr) {}
+	Object(bool val) : Collectable(GCKind::OBJECT), value(val) {}
+	Object(double val) : Collectable(GCKind::OBJECT), value(val) {}
+	Object(std::string val) : Collectable(GCKind::OBJECT), value(std::move(val)) {}
+	Object(Ref<MinikCallable> val) : Collectable(GCKind::OBJECT), value(val) {}
+	Object(Ref<MinikInstance> val) : Collectable(GCKind::OBJECT), value(val) {}
+	Object(Ref<MinikNamespace> val) : Collectable(GCKind::OBJECT), value(val) {}
+	Object(List val) : Collectable(GCKind::OBJECT), value(std::move(val)) {}
+	Object(Value val) : Collectable(GCKind::OBJECT), value(std::move(val)) {}
 
-	Object() : value(nullptr) {}
-	Object(void*) : value(nullptr) {}
-	Object(bool val) : value(val) {}
-	Object(double val) : value(val) {}
-	Object(std::string val) : value(val) {}
-	Object(Ref<MinikCallable> val) : value(val) {}
-	Object(Ref<MinikInstance> val) : value(val) {}
-	Object(Ref<MinikNamespace> val) : value(val) {}
-	Object(List val) : value(val) {}
-
-	Object(Object const &val) : value(val.value) {}
-	Object(const Ref<Object>& val) : value(val->value) {}
-
-	bool is_nil()      const { return std::holds_alternative<std::nullptr_t>(value); }
-	bool is_bool()     const { return std::holds_alternative<bool>(value); }
-	bool is_double()   const { return std::holds_alternative<double>(value); }
-	bool is_string()   const { return std::holds_alternative<std::string>(value); }
-	bool is_list()     const { return std::holds_alternative<List>(value); }
-	bool is_callable() const { return std::holds_alternative<Ref<MinikCallable>>(value); }
-	bool is_instance() const { return std::holds_alternative<Ref<MinikInstance>>(value); }
-	bool is_namespace()const { return std::holds_alternative<Ref<MinikNamespace>>(value); }
-
-	const bool&        as_bool()   const { return std::get<bool>(value); }
-	const double&      as_double() const { return std::get<double>(value); }
-	const std::string& as_string() const { return std::get<std::string>(value); }
-	const List&        as_list()   const { return std::get<List>(value); }
-	const Ref<MinikCallable>& as_callable() const { return std::get<Ref<MinikCallable>>(value); }
-	const Ref<MinikInstance>& as_instance() const { return std::get<Ref<MinikInstance>>(value); }
-	const Ref<MinikNamespace>& as_namespace() const { return std::get<Ref<MinikNamespace>>(value); }
-
-	bool&        as_bool()   { return std::get<bool>(value); }
-	double&      as_double() { return std::get<double>(value); }
-	std::string& as_string() { return std::get<std::string>(value); }
-	List&        as_list()   { return std::get<List>(value); }
-
-	std::string to_string() const {
-		if (is_nil()) {
-			return "nil";
-		} else if (is_bool()) {
-			return as_bool() ? "true" : "false";
-		} else if (is_double()) {
-			return std::to_string(as_double());
-		} else if (is_string()) {
-			return as_string();
-		} else if (is_callable()) {
-			return as_callable()->to_string();
-		} else if (is_instance()) {
-			return as_instance()->to_string();
-		} else if (is_namespace()) {
-			return as_namespace()->to_string();
-		} else if (is_list()) {
-			std::string txt = "<list>";
-			const List& list = as_list();
-			for (size_t i = 0; i < list.size(); ++i) {
-				const Ref<Object>& element = list.at(i);
-				txt += element->to_string();
-				if (i != list.size()-1) {
-					txt += ", ";
-				}
-			}
-
-			txt += "</list size="+std::to_string(list.size())+">";
-			return txt;
+	Object(Object const &val) : Collectable(GCKind::OBJECT), value(val.value.clone()) {}
+	Object(const Ref<Object>& val) : Collectable(GCKind::OBJECT), value(val->value.clone()) {}
+	~Object() {
+		if (gc_root() != 0) {
+			gc_forget_root(this);
 		}
-		return "";
 	}
 
-	bool to_bool() const {
-		if (is_nil()) {
-			return false;
-		}
-		if (is_bool()) {
-			return as_bool();
-		}
-		if (is_double()) {
-			return (as_double() != 0.0);
-		}
-		if (is_list()) {
-			return as_list().empty();
+	// a variable or field is a possible root of a cycle while it holds a list, callable or instance
+	bool release_ref() const {
+		if (--m_ref_count == 0) {
+			// a number or a string releases nothing, the Ref deletes it right away
+			if (!value.is_collectable()) {
+				return true;
+			}
+			gc_release(this);
+		} else if (gc_root() == 0 && value.is_collectable()) {
+			gc_possible_root(this);
 		}
-
-		// TODO: throw exception ?
-		// MN_ERROR("Unreachable. Object::to_bool()");
 		return false;
 	}
 
-	bool equals(const Ref<Object>& other) const {
-		if (is_nil() && other->is_nil()) {
-			return true;
-		}
-		if (is_bool() && other->is_bool()) {
-			return (as_bool() == other->as_bool());
-		}
-		if (is_double() && other->is_double()) {
-			return (as_double() == other->as_double());
-		}
-		if (is_string() && other->is_string()) {
-			return (as_string() == other->as_string());
+	bool is_nil()      const { return value.is_nil(); }
+	bool is_bool()     const { return value.is_bool(); }
+	bool is_double()   const { return value.is_double(); }
+	bool is_string()   const { return value.is_string(); }
+	bool is_list()     const { return value.is_list(); }
+	bool is_callable() const { return value.is_callable(); }
+	bool is_instance() const { return value.is_instance(); }
+	bool is_namespace()const { return value.is_namespace(); }
+
+	bool         as_bool()   const { return value.as_bool(); }
+	double       as_double() const { return value.as_double(); }
+	const std::string& as_string() const { return value.as_string(); }
+	const List&  as_list()   const { return value.as_list(); }
+	List&        mutable_list() const { return value.mutable_list(); }
+	const Ref<MinikCallable>& as_callable() const { return value.as_callable(); }
+	const Ref<MinikInstance>& as_instance() const { return value.as_instance(); }
+	const Ref<MinikNamespace>& as_namespace() const { return value.as_namespace(); }
+
+	std::string to_string() const { return value.to_string(); }
+	bool to_bool() const { return value.to_bool(); }
+	bool equals(const Ref<Object>& other) const { return value.equals(other->value); }
+
+	void trace(GCTracer& tracer) const {
+		if (const GCHeader* cell = value.gc_cell()) {
+			tracer.visit(cell);
 		}
-		return (to_bool() == other->to_bool());
 	}
 };
 
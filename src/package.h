@@ -17,9 +17,10 @@ class mpc##name : public MinikCallable { public:  \
 	m[#name] = CreateRef<Object>(CreateRef<mpc##name>());
 
 
-class Package {
+class Package : public RefCounted {
 public:
 	Package(std::string name) : name(name) {}
+	virtual ~Package() = default;
 
 	virtual void ImportPackage(const Ref<Environment>& environment, const std::string& as = "") {}
 
@@ -5,10 +5,10 @@
 #include "lexer.h"
 #include "minik.h"
 #include "resolver.h"
+#include "source_file.h"
 #include "statement.h"
 #include "token.h"
 #include <filesystem>
-#include <fstream>
 
 namespace minik {
 
@@ -33,32 +33,69 @@ bool Parser::is_at_end() const {
 	return peek().type == MEOF;
 }
 
-const Token& Parser::peek() const {
+const SourceToken& Parser::peek() const {
 	return m_tokens[m_current];
 }
-const Token& Parser::peek_next() const {
+const SourceToken& Parser::peek_next() const {
 	return m_tokens[m_current + 1];
 }
 
-const Token& Parser::previous() const {
+const SourceToken& Parser::previous() const {
 	return m_tokens[m_current - 1];
 }
 
-const Token& Parser::advance() {
+const SourceToken& Parser::advance() {
 	if (!is_at_end()) {
 		m_current++;
 	}
 	return previous();
 }
 
-const Token& Parser::consume(TokenType type, std::string message) {
+const SourceToken& Parser::consume(TokenType type, std::string message) {
 	if (check(type)) {
 		return advance();
 	}
-	throw ParseException(peek(), message);
+	throw ParseException(token(peek()), message);
 	return advance();
 }
 
+std::string_view Parser::lexeme(const SourceToken& token) const {
+	return m_source.substr(token.offset, token.length);
+}
+
+Token Parser::token(const SourceToken& token) const {
+	return Token(token.type, std::string(lexeme(token)), token.line);
+}
+
+static bool is_identifier(std::string_view text) {
+	if (text.empty() || (text[0] >= '0' && text[0] <= '9')) {
+		return false;
+	}
+	for (char c : text) {
+		bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+		if (!alpha && !(c >= '0' && c <= '9')) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// literals are decoded here, only the ones that end up in the tree
+Ref<Object> Parser::literal(const SourceToken& token) const {
+	std::string_view text = lexeme(token);
+	if (token.type == NUMBER) {
+		return CreateRef<Object>(std::stod(std::string(text)));
+	}
+
+	// trim the surrounding quotes
+	text = text.substr(1, text.length() - 2);
+	// names and keys are interned, comparing two of them compares pointers
+	if (is_identifier(text)) {
+		return CreateRef<Object>(Value::intern(text));
+	}
+	return CreateRef<Object>(Value(std::string(text)));
+}
+
 bool Parser::match(TokenType type) {
 	if (check(type)) {
 		advance();
@@ -86,16 +123,24 @@ Ref<Expression> Parser::assignment() {
 	Ref<Expression> expr = logical_or();
 
 	if (match(EQUAL)) {
-		Token equals = previous();
+		const SourceToken& equals = previous();
 		Ref<Expression> value = assignment();
 
-		if (VariableExpression* var_expr = dynamic_cast<VariableExpression*>(expr.get())) {
-			Token name = var_expr->name;
-			return CreateRef<AssignmentExpression>(name, value);
-		} else if (GetExpression* get_expr = dynamic_cast<GetExpression*>(expr.get())) {
-			return CreateRef<SetExpression>(get_expr->object, value, get_expr->name);
-		} else if (SubscriptExpression* sbs = dynamic_cast<SubscriptExpression*>(expr.get())) {
-			return CreateRef<SetSubscriptExpression>(sbs->object, sbs->key, value, sbs->name);
+		switch (expr->kind) {
+			case ExpressionKind::VARIABLE: {
+				Token name = static_cast<VariableExpression*>(expr.get())->name;
+				return CreateRef<AssignmentExpression>(name, value);
+			}
+			case ExpressionKind::GET: {
+				GetExpression* get_expr = static_cast<GetExpression*>(expr.get());
+				return CreateRef<SetExpression>(get_expr->object, value, get_expr->name);
+			}
+			case ExpressionKind::SUBSCRIPT: {
+				SubscriptExpression* sbs = static_cast<SubscriptExpression*>(expr.get());
+				return CreateRef<SetSubscriptExpression>(sbs->object, sbs->key, value, sbs->name);
+			}
+			default:
+				break;
 		}
 
 		 report_error(equals.line, "Invalid assignment target."); 
@@ -108,7 +153,7 @@ Ref<Expression> Parser::equality() {
 	Ref<Expression> expression = comparison();
 
 	while(match(BANG_EQUAL) || match(EQUAL_EQUAL)) {
-		const Token& op = previous();
+		Token op = token(previous());
 		Ref<Expression> right = comparison();
 		expression = CreateRef<BinaryExpression>(expression, op, right);
 	}
@@ -120,7 +165,7 @@ Ref<Expression> Parser::comparison() {
 	Ref<Expression> expression = term();
 
 	while(match(GREATER) || match(GREATER_EQUAL)|| match(LESS)|| match(LESS_EQUAL)) {
-		const Token& op = previous();
+		Token op = token(previous());
 		Ref<Expression> right = term();
 		expression = CreateRef<BinaryExpression>(expression, op, right);
 	}
@@ -132,7 +177,7 @@ Ref<Expression> Parser::term() {
 	Ref<Expression> expression = factor();
 
 	while(match(MINUS) || match(PLUS)) {
-		const Token& op = previous();
+		Token op = token(previous());
 		Ref<Expression> right = factor();
 		expression = CreateRef<BinaryExpression>(expression, op, right);
 	}
@@ -144,7 +189,7 @@ Ref<Expression> Parser::factor() {
 	Ref<Expression> expression = unary();
 
 	while(match(MOD) || match(SLASH) || match(STAR)) {
-		const Token& op = previous();
+		Token op = token(previous());
 		Ref<Expression> right = unary();
 		expression = CreateRef<BinaryExpression>(expression, op, right);
 	}
@@ -154,7 +199,7 @@ Ref<Expression> Parser::factor() {
 
 Ref<Expression> Parser::unary() {
 	if (match(BANG) || match(MINUS) || match(PLUS_PLUS) || match(MINUS_MINUS)) {
-		const Token& op = previous();
+		Token op = token(previous());
 		Ref<Expression> right = unary();
 		return CreateRef<UnaryExpression>(op, right);
 	}
@@ -167,15 +212,15 @@ Ref<Expression> Parser::primary() {
 	if (match(NIL))   { return CreateRef<LiteralExpression>(CreateRef<Object>(nullptr)); }
 
 	if (match(NUMBER) || match(STRING)) {
-		return CreateRef<LiteralExpression>(previous().literal);
+		return CreateRef<LiteralExpression>(literal(previous()));
 	}
 
 	if (match(THIS)) {
-		return CreateRef<ThisExpression>(previous());
+		return CreateRef<ThisExpression>(token(previous()));
 	}
 
 	if (match(IDENTIFIER)) {
-		return CreateRef<VariableExpression>(previous());
+		return CreateRef<VariableExpression>(token(previous()));
 	}
 
 	if (match(LEFT_PAREN)) {
@@ -191,7 +236,7 @@ Ref<Expression> Parser::primary() {
 		return array_size_initializer();
 	}
 
-	throw ParseException(peek(), "Expected expression.");
+	throw ParseException(token(peek()), "Expected expression.");
 	return nullptr;
 }
 
@@ -204,13 +249,13 @@ Ref<Expression> Parser::array_initializer() {
 	}
 
 	consume(RIGHT_BRACE, "Expect '}' after array elements.");
-	return CreateRef<ArrayInitializerExpression>(elements, previous());
+	return CreateRef<ArrayInitializerExpression>(elements, token(previous()));
 }
 
 Ref<Expression> Parser::array_size_initializer() {
 	Ref<Expression> size = expression();
 	consume(RIGHT_BRACKET, "Expect ']' after array size.");
-	return CreateRef<ArrayInitSizeExpression>(size, previous());
+	return CreateRef<ArrayInitSizeExpression>(size, token(previous()));
 }
 
 
@@ -218,7 +263,7 @@ Ref<Expression> Parser::logical_or() {
 	Ref<Expression> expr = logical_and();
 
 	while (match(OR)) {
-		const Token& op = previous();
+		Token op = token(previous());
 		Ref<Expression> right = logical_and();
 		expr = CreateRef<LogicalExpression>(expr, op, right);
 	}
@@ -230,7 +275,7 @@ Ref<Expression> Parser::logical_and() {
 	Ref<Expression> expr = equality();
 
 	while (match(AND)) {
-		const Token& op = previous();
+		Token op = token(previous());
 		Ref<Expression> right = equality();
 		expr = CreateRef<LogicalExpression>(expr, op, right);
 	}
@@ -244,10 +289,10 @@ Ref<Expression> Parser::call() {
 		if (match(LEFT_PAREN)) {
 			expr = finish_call(expr);
 		} else if (match(DOT)) {
-			Token name = consume(IDENTIFIER, "Expected property name after '.'.");
+			Token name = token(consume(IDENTIFIER, "Expected property name after '.'."));
 			expr = CreateRef<GetExpression>(expr, name);
 		} else if (check(LEFT_BRACKET)) {
-			Token name = previous();
+			Token name = token(previous());
 			match(LEFT_BRACKET);
 			Ref<Expression> key = expression();
 			consume(RIGHT_BRACKET, "Expected ']' after subscript expression.");
@@ -270,7 +315,7 @@ Ref<Expression> Parser::finish_call(const Ref<Expression>& callee) {
 		} while (match(COMMA));
 	}
 
-	Token paren = consume(RIGHT_PAREN, "Expected ')' after arguments.");
+	Token paren = token(consume(RIGHT_PAREN, "Expected ')' after arguments."));
 
 	return CreateRef<CallExpression>(callee, paren, arguments);
 }
@@ -365,7 +410,7 @@ Ref<Statement> Parser::declaration() {
 }
 
 Ref<Statement> Parser::typed_declaration() {
-	Token identifier = consume(IDENTIFIER, "Expected variable name.");
+	Token identifier = token(consume(IDENTIFIER, "Expected variable name."));
 
 	if (match(COLON)) {
 		// TODO: type
@@ -472,24 +517,24 @@ Ref<Statement> Parser::for_statement() {
 Ref<Statement> Parser::break_statement() {
 	// break with label
 	if (match(IDENTIFIER)) {
-		const Token& label = previous();
+		Token label = token(previous());
 		consume(SEMICOLON, "Expected ';' aftrer 'break' label.");
 		return CreateRef<BreakStatement>(label);
 	}
 
-	const Token& token = consume(SEMICOLON, "Expected ';' aftrer 'break'.");
-	return CreateRef<BreakStatement>(token);
+	Token keyword = token(consume(SEMICOLON, "Expected ';' aftrer 'break'."));
+	return CreateRef<BreakStatement>(keyword);
 }
 Ref<Statement> Parser::continue_statement() {
 	// continue with label
 	if (match(IDENTIFIER)) {
-		const Token& label = previous();
+		Token label = token(previous());
 		consume(SEMICOLON, "Expected ';' aftrer 'continue' label.");
 		return CreateRef<ContinueStatement>(label);
 	}
 
-	const Token& token = consume(SEMICOLON, "Expected ';' aftrer 'continue'.");
-	return CreateRef<ContinueStatement>(token);
+	Token keyword = token(consume(SEMICOLON, "Expected ';' aftrer 'continue'."));
+	return CreateRef<ContinueStatement>(keyword);
 }
 
 Ref<FunctionStatement> Parser::function(const Token& identifier) {
@@ -501,7 +546,7 @@ Ref<FunctionStatement> Parser::function(const Token& identifier) {
 				report_error(peek().line, "Can't have more than 255 arguments.");
 			}
 
-			parameters.emplace_back(consume(IDENTIFIER, "Expected parameter name."));
+			parameters.emplace_back(token(consume(IDENTIFIER, "Expected parameter name.")));
 			if (match(COLON)) {
 				// TODO: parameter type
 				consume(IDENTIFIER, "Expected parameter type after ':'.");
@@ -516,7 +561,7 @@ Ref<FunctionStatement> Parser::function(const Token& identifier) {
 
 
 Ref<Statement> Parser::return_statement() {
-	Token keyword = previous();
+	Token keyword = token(previous());
 	Ref<Expression> value = nullptr;
 	if (!check(SEMICOLON)) {
 		value = expression();
@@ -533,9 +578,9 @@ Ref<Statement> Parser::class_declaration(const Token& identifier) {
 	while (!check(RIGHT_BRACE) && !is_at_end()) {
 		if (check(IDENTIFIER) && check_next(COLON)) {
 			Ref<Statement> s = typed_declaration();
-			if (auto vs = std::dynamic_pointer_cast<VariableStatement>(s)) {
+			if (auto vs = DynamicRefCast<VariableStatement>(s)) {
 				members.push_back(vs);
-			} else if (auto fs = std::dynamic_pointer_cast<FunctionStatement>(s)) {
+			} else if (auto fs = DynamicRefCast<FunctionStatement>(s)) {
 				methods.push_back(fs);
 			}
 		} else {
@@ -554,13 +599,13 @@ Ref<Statement> Parser::namespace_declaration(const Token& identifier) {
 	while (!check(RIGHT_BRACE) && !is_at_end()) {
 		if (check(IDENTIFIER) && check_next(COLON)) {
 			Ref<Statement> s = typed_declaration();
-			if (auto vs = std::dynamic_pointer_cast<VariableStatement>(s)) {
+			if (auto vs = DynamicRefCast<VariableStatement>(s)) {
 				fields.push_back(vs);
-			} else if (auto fs = std::dynamic_pointer_cast<FunctionStatement>(s)) {
+			} else if (auto fs = DynamicRefCast<FunctionStatement>(s)) {
 				fields.push_back(fs);
-			} else if (auto ns = std::dynamic_pointer_cast<NamespaceStatement>(s)) {
+			} else if (auto ns = DynamicRefCast<NamespaceStatement>(s)) {
 				fields.push_back(ns);
-			} else if (auto cs = std::dynamic_pointer_cast<ClassStatement>(s)) {
+			} else if (auto cs = DynamicRefCast<ClassStatement>(s)) {
 				fields.push_back(cs);
 			}
 		} else {
@@ -574,26 +619,26 @@ Ref<Statement> Parser::namespace_declaration(const Token& identifier) {
 
 
 Ref<Statement> Parser::defer_statement() {
-	const Token& token = previous();
+	Token keyword = token(previous());
 	Ref<Statement> s = statement();
 
-	return CreateRef<DeferStatement>(token, s, nullptr);
+	return CreateRef<DeferStatement>(keyword, s);
 }
 
 Ref<Statement> Parser::label_statement() {
-	const Token& id = consume(IDENTIFIER, "Expected identifier after label.");
+	Token id = token(consume(IDENTIFIER, "Expected identifier after label."));
 	Ref<LabelStatement> statement = CreateRef<LabelStatement>(id, nullptr);
 
 	if (match(FOR)) {
 		Ref<Statement> s = for_statement();
-		if (Ref<ForStatement> fs = std::dynamic_pointer_cast<ForStatement>(s)) {
-			fs->label = statement;
+		if (Ref<ForStatement> fs = DynamicRefCast<ForStatement>(s)) {
+			fs->label = statement.get();
 			statement->loop = fs;
 		}
 	} else if (match(WHILE)) {
 		Ref<Statement> s = while_statement();
-		if (Ref<ForStatement> fs = std::dynamic_pointer_cast<ForStatement>(s)) {
-			fs->label = statement;
+		if (Ref<ForStatement> fs = DynamicRefCast<ForStatement>(s)) {
+			fs->label = statement.get();
 			statement->loop = fs;
 		}
 	} else {
@@ -603,7 +648,7 @@ Ref<Statement> Parser::label_statement() {
 	return statement;
 }
 Ref<Statement> Parser::goto_statement() {
-	const Token& id = consume(IDENTIFIER, "Expected identifier after goto.");
+	Token id = token(consume(IDENTIFIER, "Expected identifier after goto."));
 	consume(SEMICOLON, "Expected ';' after goto.");
 	return CreateRef<GotoStatement>(id);
 }
@@ -613,18 +658,18 @@ Ref<Statement> Parser::import_statement() {
 	bool is_file = false;
 
 	if (match(STRING)) {
-		package_name = previous().literal->to_string();
+		// the path is not interned or kept, it's read from the source directly
+		std::string_view path = lexeme(previous());
+		package_name = std::string(path.substr(1, path.length() - 2));
 		is_file = true;
 	} else {
-		const Token& id = consume(IDENTIFIER, "Expected identifier after import.");
-		package_name = id.lexeme;
+		package_name = std::string(lexeme(consume(IDENTIFIER, "Expected identifier after import.")));
 	}
-	Token name = previous();
+	Token name = token(previous());
 
 	std::string as = "";
 	if (match(AS)) {
-		const Token& ast = consume(IDENTIFIER, "Expected identifier after import as.");
-		as = ast.lexeme;
+		as = std::string(lexeme(consume(IDENTIFIER, "Expected identifier after import as.")));
 	}
 
 	consume(SEMICOLON, "Expected ';' after import.");
@@ -637,20 +682,14 @@ Ref<Statement> Parser::import_statement() {
 			throw ParseException(name, "import failed. File does not exist.");
 		}
 
-		std::ifstream file(std::filesystem::canonical(package_name));
+		SourceFile file(std::filesystem::canonical(package_name).string());
 		if (!file.is_open()) {
 			throw ParseException(name, "import failed at '" + package_name + "'.");
 		}
 
-		std::string source = std::string(
-			(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()
-		);
-
-		Lexer lexer = Lexer(source);
-		std::vector<Token>& tokens = lexer.scan_tokens();
-		Parser parser = Parser(tokens);
+		Lexer lexer = Lexer(file.text());
+		Parser parser = Parser(file.text(), lexer.scan_tokens());
 		statements = parser.parse();
-		file.close();
 	}
 	return CreateRef<ImportStatement>(name, statements, as, is_file);
 }
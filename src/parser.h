@@ -5,24 +5,30 @@
 #include "minik.h"
 #include "statement.h"
 #include "token.h"
+#include <string_view>
 #include <vector>
 
 namespace minik {
 
+// The tokens point into the source, it has to outlive the parse.
 class Parser {
 public:
-	Parser(const std::vector<Token>& tokens)
-		: m_tokens(tokens) {}
+	Parser(std::string_view source, std::vector<SourceToken> tokens)
+		: m_source(source), m_tokens(std::move(tokens)) {}
 
 	std::vector<Ref<Statement>> parse();
 
 private:
 	bool is_at_end() const;
-	const Token& peek() const;
-	const Token& peek_next() const;
-	const Token& previous() const;
-	const Token& advance();
-	const Token& consume(TokenType type, std::string message);
+	const SourceToken& peek() const;
+	const SourceToken& peek_next() const;
+	const SourceToken& previous() const;
+	const SourceToken& advance();
+	const SourceToken& consume(TokenType type, std::string message);
+
+	std::string_view lexeme(const SourceToken& token) const;
+	Token token(const SourceToken& token) const;
+	Ref<Object> literal(const SourceToken& token) const;
 
 	bool match(TokenType type);
 	bool check(TokenType type) const;
@@ -65,7 +71,8 @@ private:
 	Ref<Statement> import_statement();
 
 private:
-	std::vector<Token> m_tokens;
+	std::string_view m_source;
+	std::vector<SourceToken> m_tokens;
 	int m_current = 0;
 };
 
@@ -0,0 +1,148 @@
+#include "pool.h"
+#include "base.h"
+#include "log.h"
+#include <cstdlib>
+#include <new>
+
+namespace minik {
+
+static thread_local Pool* t_current = nullptr;
+static bool s_print_stats = false;
+
+static const char* type_name(PoolType type) {
+	switch (type) {
+		case PoolType::OBJECT:      return "Object";
+		case PoolType::ENVIRONMENT: return "Environment";
+		case PoolType::FUNCTION:    return "MinikFunction";
+		case PoolType::INSTANCE:    return "MinikInstance";
+		default: return "";
+	}
+}
+
+
+Pool::Pool() : m_previous(t_current) {
+	t_current = this;
+}
+
+Pool::~Pool() {
+	if (s_print_stats) {
+		print_stats();
+	}
+	// pools are destroyed in the reverse order they were created
+	t_current = m_previous;
+
+	// the collector ran before, blocks still in use here are cycles it doesn't traverse.
+	// Their slabs are freed without running their destructors, what they own leaks
+	uint64_t live = 0;
+	for (const PoolStats& stats : m_stats) {
+		live += stats.allocations - stats.frees;
+	}
+	if (live != 0) {
+		MN_ERROR("pool: %llu objects leaked", (unsigned long long)live);
+	}
+	while (m_slabs) {
+		Slab* next = m_slabs->next;
+		std::free(m_slabs);
+		m_slabs = next;
+	}
+}
+
+void Pool::set_print_stats(bool print) {
+	s_print_stats = print;
+}
+
+Pool& Pool::current() {
+	if (!t_current) {
+		// allocations outside of an interpreter, the pool lives as long as the thread
+		new Pool();
+	}
+	return *t_current;
+}
+
+size_t Pool::bytes_in_use() {
+	size_t bytes = 0;
+	for (const PoolStats& stats : current().m_stats) {
+		bytes += stats.bytes;
+	}
+	return bytes;
+}
+
+void* Pool::allocate(size_t size, PoolType type) {
+	if (size > MAX_SIZE) {
+		return ::operator new(size);
+	}
+	Pool& pool = current();
+
+	PoolStats& stats = pool.m_stats[(size_t)type];
+	stats.allocations++;
+	stats.bytes += size;
+	if (stats.bytes > stats.peak_bytes) {
+		stats.peak_bytes = stats.bytes;
+	}
+	return pool.allocate_block((size - 1) / GRANULE);
+}
+
+void Pool::deallocate(void* block, size_t size, PoolType type) {
+	if (size > MAX_SIZE) {
+		::operator delete(block);
+		return;
+	}
+	Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(block) & ~(uintptr_t)(SLAB_SIZE - 1));
+	Pool& pool = *slab->pool;
+
+	PoolStats& stats = pool.m_stats[(size_t)type];
+	stats.frees++;
+	stats.bytes -= size;
+
+	SizeClass& size_class = pool.m_classes[(size - 1) / GRANULE];
+	FreeBlock* free_block = static_cast<FreeBlock*>(block);
+	free_block->next = size_class.free;
+	size_class.free = free_block;
+}
+
+void* Pool::allocate_block(size_t index) {
+	SizeClass& size_class = m_classes[index];
+	if (size_class.free) {
+		FreeBlock* block = size_class.free;
+		size_class.free = block->next;
+		return block;
+	}
+
+	const size_t block_size = (index + 1) * GRANULE;
+	if (size_class.bump + block_size > size_class.end) {
+		add_slab(index);
+	}
+	void* block = size_class.bump;
+	size_class.bump += block_size;
+	return block;
+}
+
+void Pool::add_slab(size_t index) {
+	void* memory = std::aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+	if (!memory) {
+		throw std::bad_alloc();
+	}
+	Slab* slab = static_cast<Slab*>(memory);
+	slab->pool = this;
+	slab->next = m_slabs;
+	m_slabs = slab;
+	m_slab_count++;
+
+	// the rest of the previous slab of this class is left unused
+	SizeClass& size_class = m_classes[index];
+	size_class.bump = static_cast<char*>(memory) + ((sizeof(Slab) + GRANULE - 1) / GRANULE) * GRANULE;
+	size_class.end = static_cast<char*>(memory) + SLAB_SIZE;
+}
+
+void Pool::print_stats() const {
+	MN_PRINT_LN("pool: %zu slabs, %zu KiB", m_slab_count, m_slab_count * SLAB_SIZE / 1024);
+	for (size_t i = 0; i < (size_t)PoolType::COUNT; ++i) {
+		const PoolStats& stats = m_stats[i];
+		MN_PRINT_LN("  %-14s allocations %10llu  frees %10llu  live %8llu  peak %10zu bytes",
+			type_name((PoolType)i),
+			(unsigned long long)stats.allocations, (unsigned long long)stats.frees,
+			(unsigned long long)(stats.allocations - stats.frees), stats.peak_bytes);
+	}
+}
+
+}
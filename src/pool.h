@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace minik {
+
+// runtime objects allocated from a Pool, for the statistics
+enum class PoolType : uint8_t { OBJECT, ENVIRONMENT, FUNCTION, INSTANCE, COUNT };
+
+struct PoolStats {
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	size_t bytes = 0;
+	size_t peak_bytes = 0;
+};
+
+// Size class allocator for the small objects the interpreter creates and drops all the time.
+// Blocks are carved from aligned slabs that each serve one size class, allocating pops the
+// free list of the class or bumps a pointer in its last slab. The slab header points back
+// to its pool, so a block is returned to the pool it came from whichever pool is current.
+// Every thread has a current pool, an Interpreter makes its own pool current while it lives
+// and releases all its slabs at once when it is destroyed.
+class Pool {
+public:
+	Pool();
+	~Pool();
+	Pool(const Pool&) = delete;
+	Pool& operator=(const Pool&) = delete;
+
+	static void* allocate(size_t size, PoolType type);
+	static void deallocate(void* block, size_t size, PoolType type);
+
+	// print the statistics of each pool when it is destroyed
+	static void set_print_stats(bool print);
+
+	// bytes in use in the current pool
+	static size_t bytes_in_use();
+
+	const PoolStats& stats(PoolType type) const { return m_stats[(size_t)type]; }
+	void print_stats() const;
+
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+	static constexpr size_t GRANULE = 16;
+	// larger blocks go to the global allocator
+	static constexpr size_t MAX_SIZE = 512;
+
+private:
+	static constexpr size_t CLASS_COUNT = MAX_SIZE / GRANULE;
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+	struct Slab {
+		Pool* pool;
+		Slab* next;
+	};
+	struct SizeClass {
+		FreeBlock* free = nullptr;
+		char* bump = nullptr;
+		char* end = nullptr;
+	};
+
+	static Pool& current();
+	void* allocate_block(size_t size_class);
+	void add_slab(size_t size_class);
+
+private:
+	SizeClass m_classes[CLASS_COUNT] = {};
+	Slab* m_slabs = nullptr;
+	size_t m_slab_count = 0;
+	PoolStats m_stats[(size_t)PoolType::COUNT] = {};
+	Pool* m_previous = nullptr;
+};
+
+// allocates a class from the current pool
+template<PoolType TYPE>
+struct Pooled {
+	static void* operator new(size_t size) { return Pool::allocate(size, TYPE); }
+	static void operator delete(void* block, size_t size) { Pool::deallocate(block, size, TYPE); }
+};
+
+}
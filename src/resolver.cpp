@@ -8,26 +8,44 @@
 namespace minik {
 
 
-void Resolver::resolve_block(const std::vector<Ref<Statement>>& statements) {
-	// collect labels
-	for (const Ref<Statement>& statement : statements) {
-		if (LabelStatement* s = dynamic_cast<LabelStatement*>(statement.get())) {
+std::vector<Statement*> Resolver::resolve_block(const std::vector<Ref<Statement>>& statements) {
+	// collect labels and declarations to hoist
+	LabelTable table = {};
+	std::vector<Statement*> hoisted = {};
+	for (size_t i = 0; i < statements.size(); ++i) {
+		Statement* statement = statements[i].get();
+		switch (statement->kind) {
+			case StatementKind::FUNCTION:
+			case StatementKind::CLASS:
+			case StatementKind::NAMESPACE:
+			case StatementKind::IMPORT:
+				hoisted.push_back(statement);
+				break;
+			default:
+				break;
+		}
+		if (statement->kind == StatementKind::LABEL) {
+			LabelStatement* s = static_cast<LabelStatement*>(statement);
 			ResolverScope& scope = m_scopes.back();
-			if (scope.count(s->name.lexeme) > 0) {
+			if (scope.symbols.count(s->name.lexeme) > 0) {
 				report_error(s->name.line, "Variable with name '"
 					+s->name.lexeme+"' already exists in this scope.");
 			}
 			if (s->loop) {
-				scope[s->name.lexeme] = SymbolState::LOOP_LABEL;
+				scope.symbols[s->name.lexeme] = {SymbolState::LOOP_LABEL};
 			} else {
-				scope[s->name.lexeme] = SymbolState::NAKED_LABEL;
+				scope.symbols[s->name.lexeme] = {SymbolState::NAKED_LABEL};
+				table[s->name.lexeme] = i;
 			}
 		}
 	}
 
+	m_label_tables.push_back(std::move(table));
 	for (const Ref<Statement>& statement : statements) {
 		resolve(statement);
 	}
+	m_label_tables.pop_back();
+	return hoisted;
 }
 void Resolver::resolve(const Ref<Statement>& statement) {
 	statement->accept(*this);
@@ -35,39 +53,127 @@ void Resolver::resolve(const Ref<Statement>& statement) {
 void Resolver::resolve(const Ref<Expression>& expression) {
 	expression->accept(*this);
 }
-void Resolver::resolve_local(const Expression& expression, const Token& token) {
+// returns the index of the scope the variable was found in, -1 for globals
+int Resolver::resolve_local(Binding& binding, const Token& token) {
 	for (int i = m_scopes.size() - 1; i >= 0; i--) {
-		if (m_scopes[i].count(token.lexeme) > 0) {
-			m_interpreter.resolve(expression, m_scopes.size() - 1 - i);
+		auto it = m_scopes[i].symbols.find(token.lexeme);
+		if (it != m_scopes[i].symbols.end()) {
+			binding.depth = m_scopes.size() - 1 - i;
+			binding.slot = it->second.slot;
+			if (binding.slot >= 0) {
+				capture(i, binding.depth, binding.slot);
+			} else if (i == 0 && m_global_scope) {
+				binding.global = m_interpreter.m_globals->index_of(token.lexeme);
+			} else {
+				keep_closures(i);
+			}
+			return i;
+		}
+	}
+	// not declared in any enclosing scope, looked up in the globals at runtime
+	binding.global = m_interpreter.m_globals->index_of(token.lexeme);
+	return -1;
+}
+// functions declared in a namespace keep it in a hidden slot, variables found
+// outside of such a function may be shadowed by a field of the namespace
+void Resolver::resolve_namespace(Binding& binding, int scope) {
+	for (int i = m_scopes.size() - 1; i > scope; i--) {
+		auto it = m_scopes[i].symbols.find(NAMESPACE_TOKEN.lexeme);
+		if (it != m_scopes[i].symbols.end()) {
+			binding.namespace_depth = m_scopes.size() - 1 - i;
+			binding.namespace_slot = it->second.slot;
+			capture(i, binding.namespace_depth, binding.namespace_slot);
 			return;
 		}
 	}
 }
-void Resolver::resolve_function(const FunctionStatement& s, FunctionType type) {
+// a slot of an enclosing function is copied into every function between it and
+// the current one when they are created, the binding points at the innermost copy
+void Resolver::capture(int scope, int& depth, int& slot) {
+	int source_scope = scope;
+	int source_slot = slot;
+	for (const ResolverFunction& function : m_functions) {
+		if (function.scope <= scope) {
+			continue;
+		}
+		// seen from the environment the function is created in
+		const int source_depth = function.scope - 1 - source_scope;
+		std::vector<Capture>& captures = function.statement->captures;
+		int target = -1;
+		for (const Capture& captured : captures) {
+			if (captured.depth == source_depth && captured.slot == source_slot) {
+				target = captured.target;
+				break;
+			}
+		}
+		if (target < 0) {
+			target = m_scopes[function.scope].slot_count++;
+			captures.push_back(Capture{source_depth, source_slot, target});
+		}
+		source_scope = function.scope;
+		source_slot = target;
+	}
+	depth = m_scopes.size() - 1 - source_scope;
+	slot = source_slot;
+}
+// variables looked up by name need the environments of the enclosing scopes
+void Resolver::keep_closures(int scope) {
+	for (const ResolverFunction& function : m_functions) {
+		if (function.scope > scope) {
+			function.statement->needs_closure = true;
+		}
+	}
+}
+void Resolver::resolve_function(const FunctionStatement& s, FunctionType type, bool in_namespace) {
 	FunctionType enclosing_function = m_current_function;
 	m_current_function = type;
 
 	BlockStatement* enclosing_block = m_current_block;
 	m_current_block = s.body.get();
+
+	size_t enclosing_label_table = m_function_label_table;
+	m_function_label_table = m_label_tables.size();
 	
+	// parameters take the first slots of the function environment
 	begin_scope();
+	FunctionStatement& function = const_cast<FunctionStatement&>(s);
+	function.captures.clear();
+	function.needs_closure = false;
+	function.is_method = (type == FunctionType::METHOD || type == FunctionType::INITIALIZER);
+	m_functions.push_back(ResolverFunction{(int)m_scopes.size() - 1, &function});
+
 	for (const Token& param : s.params) {
-		declare(param);
+		declare_local(param);
 		define(param);
 	}
-	resolve_block(s.body->statements);
-	end_scope();
+	if (function.is_method) {
+		// the slot after the parameters, methods are called with the instance in it
+		declare_local(THIS_TOKEN);
+		define(THIS_TOKEN);
+	}
+	if (in_namespace) {
+		// the slot after the parameters
+		declare_local(NAMESPACE_TOKEN);
+		define(NAMESPACE_TOKEN);
+	}
+	s.body->hoisted = resolve_block(s.body->statements);
+	m_functions.pop_back();
+	s.body->slot_count = end_scope();
 
+	m_function_label_table = enclosing_label_table;
 	m_current_block = enclosing_block;
 	m_current_function = enclosing_function;
 }
 
 
-void Resolver::begin_scope() {
+void Resolver::begin_scope(bool has_slots) {
 	m_scopes.push_back({});
+	m_scopes.back().has_slots = has_slots;
 }
-void Resolver::end_scope() {
+int Resolver::end_scope() {
+	int slot_count = m_scopes.back().slot_count;
 	m_scopes.pop_back();
+	return slot_count;
 }
 
 void Resolver::declare(const Token& name) {
@@ -77,12 +183,23 @@ void Resolver::declare(const Token& name) {
 
 	ResolverScope& scope = m_scopes.back();
 
-	if (scope.count(name.lexeme) > 0) {
+	if (scope.symbols.count(name.lexeme) > 0) {
 		report_error(name.line, "Variable with name '"
 			   +name.lexeme+"' already exists in this scope.");
 	}
 
-	scope[name.lexeme] = SymbolState::DECLARED;
+	scope.symbols[name.lexeme] = {SymbolState::DECLARED};
+}
+int Resolver::declare_local(const Token& name) {
+	declare(name);
+	if (m_scopes.empty() || !m_scopes.back().has_slots) {
+		return -1;
+	}
+
+	ResolverScope& scope = m_scopes.back();
+	int slot = scope.slot_count++;
+	scope.symbols[name.lexeme].slot = slot;
+	return slot;
 }
 void Resolver::define(const std::string& name) {
 	if (m_scopes.empty()) {
@@ -90,7 +207,7 @@ void Resolver::define(const std::string& name) {
 	}
 
 	ResolverScope& scope = m_scopes.back();
-	scope[name] = SymbolState::DEFINED;
+	scope.symbols[name].state = SymbolState::DEFINED;
 }
 
 
@@ -98,16 +215,37 @@ void Resolver::visit(const BlockStatement& s) {
 	BlockStatement* enclosing_block = m_current_block;
 	m_current_block = const_cast<BlockStatement*>(&s);
 
-	begin_scope();
-	resolve_block(s.statements);
-	end_scope();
+	BlockStatement& block = const_cast<BlockStatement&>(s);
+	block.scoped = false;
+	for (const Ref<Statement>& statement : s.statements) {
+		switch (statement->kind) {
+			case StatementKind::VARIABLE:
+			case StatementKind::FUNCTION:
+			case StatementKind::CLASS:
+			case StatementKind::NAMESPACE:
+			case StatementKind::IMPORT:
+			case StatementKind::LABEL:
+				block.scoped = true;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (block.scoped) {
+		begin_scope();
+	}
+	block.hoisted = resolve_block(s.statements);
+	if (block.scoped) {
+		block.slot_count = end_scope();
+	}
 
 	m_current_block = enclosing_block;
 }
 
 
 void Resolver::visit(const VariableStatement& s) {
-	declare(s.name);
+	const_cast<VariableStatement&>(s).slot = declare_local(s.name);
 	if (s.initializer) {
 		resolve(s.initializer);
 	}
@@ -146,8 +284,9 @@ void Resolver::visit(const ReturnStatement& s) {
 
 bool Resolver::label_exists(const Token& label, SymbolState state) {
 	for (int i = m_scopes.size() - 1; i >= 0; i--) {
-		if (m_scopes[i].count(label.lexeme) > 0) {
-			return m_scopes[i].at(label.lexeme) == state;
+		auto it = m_scopes[i].symbols.find(label.lexeme);
+		if (it != m_scopes[i].symbols.end()) {
+			return it->second.state == state;
 		}
 	}
 	return false;
@@ -180,7 +319,11 @@ void Resolver::visit(const ForStatement& s) {
 	LoopType enclosing_loop = m_current_loop;
 	m_current_loop = LoopType::FOR;
 
-	begin_scope();
+	ForStatement& loop = const_cast<ForStatement&>(s);
+	loop.scoped = s.initializer && s.initializer->kind == StatementKind::VARIABLE;
+	if (loop.scoped) {
+		begin_scope();
+	}
 	if (s.initializer) {
 		resolve(s.initializer);
 	}
@@ -191,7 +334,9 @@ void Resolver::visit(const ForStatement& s) {
 		resolve(s.increment);
 	}
 	resolve(s.body);
-	end_scope();
+	if (loop.scoped) {
+		loop.slot_count = end_scope();
+	}
 
 	m_current_loop = enclosing_loop;
 }
@@ -203,9 +348,6 @@ void Resolver::visit(const ClassStatement& s) {
 	declare(s.name);
 	define(s.name);
 
-	begin_scope();
-	define("this");
-
 	for (const Ref<FunctionStatement>& method : s.methods) {
 		FunctionType declaration = FunctionType::METHOD;
 		if (method->name.lexeme == s.name.lexeme) {
@@ -214,10 +356,11 @@ void Resolver::visit(const ClassStatement& s) {
 		resolve_function(*method.get(), declaration);
 	}
 
-	end_scope();
-
+	// members are evaluated in the class closure when an instance is created
 	for (const Ref<VariableStatement>& member : s.members) {
-		resolve(member);
+		if (member->initializer) {
+			resolve(member->initializer);
+		}
 	}
 
 
@@ -231,10 +374,17 @@ void Resolver::visit(const NamespaceStatement& s) {
 // 	declare(s.name);
 	define(s.name);
 
-	begin_scope();
+	begin_scope(false);
 
 	for (const Ref<Statement>& field : s.body) {
-		resolve(field);
+		if (field->kind == StatementKind::FUNCTION) {
+			const FunctionStatement& function = *static_cast<FunctionStatement*>(field.get());
+			declare(function.name);
+			define(function.name);
+			resolve_function(function, FunctionType::FUNCTION, true);
+		} else {
+			resolve(field);
+		}
 	}
 
 	end_scope();
@@ -255,7 +405,6 @@ void Resolver::visit(const DeferStatement& s) {
 		report_error(s.token.line, "'defer' can only be used inside a block.");
 		return;
 	}
-	const_cast<DeferStatement*>(&s)->enclosing_block = m_current_block;
 	resolve(s.statement);
 }
 
@@ -264,9 +413,9 @@ void Resolver::visit(const LabelStatement& s) {
 		ResolverScope& scope = m_scopes.back();
 
 		if (s.loop) {
-			scope[s.name.lexeme] = SymbolState::LOOP_LABEL;
+			scope.symbols[s.name.lexeme] = {SymbolState::LOOP_LABEL};
 		} else {
-			scope[s.name.lexeme] = SymbolState::NAKED_LABEL;
+			scope.symbols[s.name.lexeme] = {SymbolState::NAKED_LABEL};
 		}
 	}
 
@@ -276,30 +425,38 @@ void Resolver::visit(const LabelStatement& s) {
 }
 
 void Resolver::visit(const GotoStatement& s) {
-	if (!label_exists(s.label, SymbolState::NAKED_LABEL)) {
-		report_error(s.label.line, "Invalid 'goto' label: The label '"
-			   +s.label.lexeme+"' does not exist in the current scope.");
+	for (int i = m_label_tables.size() - 1; i >= (int)m_function_label_table; i--) {
+		auto it = m_label_tables[i].find(s.label.lexeme);
+		if (it != m_label_tables[i].end()) {
+			GotoStatement& statement = const_cast<GotoStatement&>(s);
+			statement.depth = m_label_tables.size() - 1 - i;
+			statement.index = it->second;
+			return;
+		}
 	}
+	report_error(s.label.line, "Invalid 'goto' label: The label '"
+		   +s.label.lexeme+"' does not exist in the current scope.");
 }
 
 
 
 void Resolver::visit(const VariableExpression& e) {
 	if (!m_scopes.empty()) {
-		auto it = m_scopes.back().find(e.name.lexeme);
-		if (it != m_scopes.back().end()) {
-			if (it->second != SymbolState::DEFINED) {
+		auto it = m_scopes.back().symbols.find(e.name.lexeme);
+		if (it != m_scopes.back().symbols.end()) {
+			if (it->second.state != SymbolState::DEFINED) {
 				report_error(e.name.line, "Cannot read local variable '"
 				 +e.name.lexeme+"' in its own initializer.");
 			}
 		}
 	}
-	resolve_local(e, e.name);
+	Binding& binding = const_cast<VariableExpression&>(e).binding;
+	resolve_namespace(binding, resolve_local(binding, e.name));
 }
 
 void Resolver::visit(const AssignmentExpression& e) {
 	resolve(e.value);
-	resolve_local(e, e.name);
+	resolve_local(const_cast<AssignmentExpression&>(e).binding, e.name);
 }
 void Resolver::visit(const BinaryExpression& e) {
 	resolve(e.left);
@@ -333,7 +490,7 @@ void Resolver::visit(const ThisExpression& e) {
 		report_error(e.keyword.line, "Cannot use 'this' outside of a class.");
 		return;
 	}
-	resolve_local(e, e.keyword);
+	resolve_local(const_cast<ThisExpression&>(e).binding, e.keyword);
 }
 
 void Resolver::visit(const SubscriptExpression& e) {
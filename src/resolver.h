@@ -8,7 +8,25 @@
 namespace minik {
 
 enum class SymbolState { DECLARED, DEFINED, NAKED_LABEL, LOOP_LABEL };
-using ResolverScope = std::unordered_map<std::string, SymbolState>;
+struct ResolverSymbol {
+	SymbolState state;
+	int slot = -1;
+};
+struct ResolverScope {
+	std::unordered_map<std::string, ResolverSymbol> symbols = {};
+	// the global scope and namespaces keep their variables by name
+	bool has_slots = false;
+	int slot_count = 0;
+};
+
+// a function being resolved and the index of its scope
+struct ResolverFunction {
+	int scope;
+	FunctionStatement* statement;
+};
+
+// index of the naked labels of a block, the targets of goto
+using LabelTable = std::unordered_map<std::string, size_t>;
 
 enum class FunctionType { NONE, FUNCTION, INITIALIZER, METHOD };
 enum class LoopType { NONE, FOR };
@@ -17,8 +35,9 @@ enum class NamespaceType { NONE, NAMESPACE };
 
 class Resolver : public Visitor {
 public:
-	Resolver(Interpreter& interpreter)
-		: m_interpreter(interpreter) {}
+	// global_scope is set when the outermost scope is the global environment
+	Resolver(Interpreter& interpreter, bool global_scope = true)
+		: m_interpreter(interpreter), m_global_scope(global_scope) {}
 
 	virtual void visit(const BinaryExpression& e)     override;
 	virtual void visit(const UnaryExpression& e)      override;
@@ -51,19 +70,24 @@ public:
 	virtual void visit(const LabelStatement& s)      override;
 	virtual void visit(const GotoStatement& s)       override;
 
-	void resolve_block(const std::vector<Ref<Statement>>& statements);
+	// returns the declarations to hoist when the block is entered
+	std::vector<Statement*> resolve_block(const std::vector<Ref<Statement>>& statements);
 private:
 	void resolve(const Ref<Statement>& statement);
 	void resolve(const Ref<Expression>& expression);
-	void resolve_local(const Expression& expression, const Token& token);
-	void resolve_function(const FunctionStatement& s, FunctionType type);
+	int resolve_local(Binding& binding, const Token& token);
+	void resolve_namespace(Binding& binding, int scope);
+	void capture(int scope, int& depth, int& slot);
+	void keep_closures(int scope);
+	void resolve_function(const FunctionStatement& s, FunctionType type, bool in_namespace = false);
 
 	bool label_exists(const Token& label, SymbolState state);
 
-	void begin_scope();
-	void end_scope();
+	void begin_scope(bool has_slots = true);
+	int end_scope();
 
 	void declare(const Token& name);
+	int declare_local(const Token& name);
 	void define(const Token& name) { define(name.lexeme); }
 	void define(const std::string& name);
 
@@ -71,6 +95,7 @@ private:
 
 private:
 	Interpreter& m_interpreter;
+	bool m_global_scope;
 	std::vector<ResolverScope> m_scopes = {{}};
 	FunctionType m_current_function = FunctionType::NONE;
 	LoopType m_current_loop = LoopType::NONE;
@@ -79,6 +104,13 @@ private:
 
 	BlockStatement* m_current_block = nullptr;
 
+	// innermost last, the functions a captured variable is copied through
+	std::vector<ResolverFunction> m_functions = {};
+
+	// one table for each block being resolved, a goto can't leave its function
+	std::vector<LabelTable> m_label_tables = {};
+	size_t m_function_label_table = 0;
+
 };
 
 }
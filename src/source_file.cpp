@@ -0,0 +1,59 @@
+#include "source_file.h"
+#include "base.h"
+#include <fstream>
+#include <iterator>
+
+#ifdef MN_PLATFORM_LINUX
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace minik {
+
+SourceFile::SourceFile(const std::string& path) {
+#ifdef MN_PLATFORM_LINUX
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		struct stat info;
+		if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+			if (info.st_size == 0) {
+				m_open = true;
+			} else {
+				void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapping != MAP_FAILED) {
+					m_mapping = mapping;
+					m_size = info.st_size;
+					m_text = std::string_view(static_cast<const char*>(mapping), m_size);
+					m_open = true;
+				}
+			}
+		}
+		::close(fd);
+		if (m_open) {
+			return;
+		}
+	}
+#endif
+
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		return;
+	}
+	m_contents = std::string(
+		(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()
+	);
+	m_text = m_contents;
+	m_open = true;
+}
+
+SourceFile::~SourceFile() {
+#ifdef MN_PLATFORM_LINUX
+	if (m_mapping) {
+		::munmap(m_mapping, m_size);
+	}
+#endif
+}
+
+}
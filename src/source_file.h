@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace minik {
+
+// Text of a script file, memory mapped where the platform allows it and read otherwise.
+// The tokens of the lexer point into it, it has to outlive the parse.
+class SourceFile {
+public:
+	SourceFile(const std::string& path);
+	~SourceFile();
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator=(const SourceFile&) = delete;
+
+	bool is_open() const { return m_open; }
+	std::string_view text() const { return m_text; }
+
+private:
+	std::string_view m_text;
+	bool m_open = false;
+
+	void* m_mapping = nullptr;
+	size_t m_size = 0;
+	std::string m_contents;
+};
+
+}
@@ -8,7 +8,18 @@
 namespace minik {
 
 
-struct Statement {
+enum class StatementKind {
+	EXPRESSION, VARIABLE, BLOCK, IF,
+	FOR, BREAK, CONTINUE, FUNCTION,
+	RETURN, CLASS, NAMESPACE, DEFER,
+	LABEL, GOTO, IMPORT
+};
+
+struct Statement : public RefCounted {
+	// set by the constructor of each node, type tests switch on it
+	const StatementKind kind;
+
+	Statement(StatementKind kind) : kind(kind) {}
 	virtual ~Statement() = default;
 	virtual void accept(Visitor& visitor) {}
 };
@@ -17,7 +28,7 @@ struct ExpressionStatement : public Statement {
 	Ref<Expression> expression;
 
 	ExpressionStatement(const Ref<Expression>& expression)
-		: expression(expression) {}
+		: Statement(StatementKind::EXPRESSION), expression(expression) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -25,21 +36,29 @@ struct ExpressionStatement : public Statement {
 struct VariableStatement : public Statement {
 	Token name;
 	Ref<Expression> initializer;
+	// set by the resolver, -1 for variables of the global scope and namespaces
+	int slot = -1;
 
 	VariableStatement(const Token& name, const Ref<Expression>& initializer)
-		: name(name), initializer(initializer) {}
+		: Statement(StatementKind::VARIABLE), name(name), initializer(initializer) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
 
 struct BlockStatement : public Statement {
 	std::vector<Ref<Statement>> statements;
-	std::vector<Ref<Statement>> deferred_statements = {};
+	// size of the environment of this block, for function bodies it includes the parameters
+	int slot_count = 0;
+	// false when the block declares nothing, it then runs in the enclosing environment
+	bool scoped = true;
+	// functions, classes, namespaces and imports of this block, collected by the resolver
+	// and created when the block is entered
+	std::vector<Statement*> hoisted = {};
 
 	BlockStatement(const std::vector<Ref<Statement>>& statements)
-		: statements(statements) {}
+		: Statement(StatementKind::BLOCK), statements(statements) {}
 	BlockStatement(const Ref<Statement>& statement)
-		: statements({statement}) {}
+		: Statement(StatementKind::BLOCK), statements({statement}) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -50,7 +69,7 @@ struct IfStatement : public Statement {
 	Ref<BlockStatement> else_branch;
 
 	IfStatement(const Ref<Expression>& condition, const Ref<BlockStatement>& then_branch, const Ref<BlockStatement>& else_branch)
-		: condition(condition), then_branch(then_branch), else_branch(else_branch) {}
+		: Statement(StatementKind::IF), condition(condition), then_branch(then_branch), else_branch(else_branch) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -60,15 +79,20 @@ struct ForStatement : public Statement {
 	Ref<Expression> condition;
 	Ref<Expression> increment;
 	Ref<BlockStatement> body;
-	Ref<LabelStatement> label = nullptr;
+	// the label owns the loop, not the other way around
+	LabelStatement* label = nullptr;
+	// size of the environment holding the initializer
+	int slot_count = 0;
+	// false when there is no initializer to declare
+	bool scoped = true;
 
 	ForStatement(const Ref<Statement>& initializer, const Ref<Expression>& condition,
 			  const Ref<Expression>& increment, const Ref<BlockStatement>& body)
-		: initializer(initializer), condition(condition), increment(increment), body(body) {}
+		: Statement(StatementKind::FOR), initializer(initializer), condition(condition), increment(increment), body(body) {}
 
 	// while
 	ForStatement(const Ref<Expression>& condition, const Ref<BlockStatement>& body)
-		: initializer(nullptr), condition(condition), increment(nullptr), body(body) {}
+		: Statement(StatementKind::FOR), initializer(nullptr), condition(condition), increment(nullptr), body(body) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -77,7 +101,7 @@ struct BreakStatement : public Statement {
 	Token keyword;
 
 	BreakStatement(const Token& keyword)
-		: keyword(keyword) {}
+		: Statement(StatementKind::BREAK), keyword(keyword) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -85,18 +109,32 @@ struct ContinueStatement : public Statement {
 	Token keyword;
 
 	ContinueStatement(const Token& keyword)
-		: keyword(keyword) {}
+		: Statement(StatementKind::CONTINUE), keyword(keyword) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
 
+// a variable of an enclosing function used by a nested one, at depth and slot
+// of the environment the function is created in, copied to slot target of its own
+struct Capture {
+	int depth;
+	int slot;
+	int target;
+};
+
 struct FunctionStatement : public Statement {
 	Token name;
 	std::vector<Token> params;
 	Ref<BlockStatement> body;
+	std::vector<Capture> captures = {};
+	// set when the body looks up a variable of an enclosing scope by name,
+	// the function then keeps the environment it was created in
+	bool needs_closure = false;
+	// methods get 'this' in the slot after the parameters
+	bool is_method = false;
 
 	FunctionStatement(const Token& name, const std::vector<Token>& params, const Ref<BlockStatement>& body)
-		: name(name), params(params), body(body) {}
+		: Statement(StatementKind::FUNCTION), name(name), params(params), body(body) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -106,7 +144,7 @@ struct ReturnStatement : public Statement {
 	Ref<Expression> value;
 
 	ReturnStatement(const Token& keyword, const Ref<Expression>& value)
-		: keyword(keyword), value(value) {}
+		: Statement(StatementKind::RETURN), keyword(keyword), value(value) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -117,7 +155,7 @@ struct ClassStatement : public Statement {
 	std::vector<Ref<VariableStatement>> members;
 
 	ClassStatement(const Token& name, const std::vector<Ref<FunctionStatement>>& methods, const std::vector<Ref<VariableStatement>>& members)
-		: name(name), methods(methods), members(members) {}
+		: Statement(StatementKind::CLASS), name(name), methods(methods), members(members) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -127,7 +165,7 @@ struct NamespaceStatement : public Statement {
 	std::vector<Ref<Statement>> body;
 
 	NamespaceStatement(const Token& name, const std::vector<Ref<Statement>>& body)
-		: name(name), body(body) {}
+		: Statement(StatementKind::NAMESPACE), name(name), body(body) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -135,10 +173,9 @@ struct NamespaceStatement : public Statement {
 struct DeferStatement : public Statement {
 	Token token;
 	Ref<Statement> statement;
-	BlockStatement* enclosing_block;
 
-	DeferStatement(const Token& token, const Ref<Statement>& statement, BlockStatement* enclosing_block)
-		: token(token), statement(statement), enclosing_block(enclosing_block) {}
+	DeferStatement(const Token& token, const Ref<Statement>& statement)
+		: Statement(StatementKind::DEFER), token(token), statement(statement) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -148,15 +185,18 @@ struct LabelStatement : public Statement {
 	Ref<ForStatement> loop;
 
 	LabelStatement(const Token& token, const Ref<ForStatement>& loop)
-		: name(token), loop(loop) {}
+		: Statement(StatementKind::LABEL), name(token), loop(loop) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
 
 struct GotoStatement : public Statement {
 	Token label;
+	// set by the resolver, the number of blocks to leave and the index of the label in the target block
+	int depth = 0;
+	size_t index = 0;
 
-	GotoStatement(const Token& token) : label(token) {}
+	GotoStatement(const Token& token) : Statement(StatementKind::GOTO), label(token) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
@@ -168,7 +208,7 @@ struct ImportStatement : public Statement {
 	bool is_file;
 
 	ImportStatement(const Token& token, const std::vector<Ref<Statement>>& statements, const std::string& as, bool is_file)
-		: name(token), statements(statements), as(as), is_file(is_file) {}
+		: Statement(StatementKind::IMPORT), name(token), statements(statements), as(as), is_file(is_file) {}
 
 	void accept(Visitor& visitor) override { visitor.visit(*this); }
 };
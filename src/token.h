@@ -1,9 +1,8 @@
 #pragma once
 
 #include "base.h"
-#include "object.h"
+#include <cstdint>
 #include <string>
-#include <variant>
 
 namespace minik {
 
@@ -95,25 +94,33 @@ const static std::string token_type_to_string(TokenType type) {
 }
 
 
+// token as the lexer emits it, the range of the source it spans.
+// The parser decodes the literals and makes a Token of the ones the tree keeps
+struct SourceToken {
+	TokenType type;
+	uint32_t line;
+	uint32_t offset;
+	uint32_t length;
+};
+
 class Token {
 public:
 	TokenType type;
 	std::string lexeme;
-	Ref<Object> literal;
 	uint32_t line;
 
-	Token(TokenType type, std::string lexeme, Ref<Object> literal, uint32_t line)
-		: type(type), lexeme(lexeme), literal(literal), line(line) {}
+	Token(TokenType type, std::string lexeme, uint32_t line)
+		: type(type), lexeme(std::move(lexeme)), line(line) {}
 
 
 	std::string to_string() const {
-		return token_type_to_string(type) + " " + lexeme + " " + literal->to_string();
+		return token_type_to_string(type) + " " + lexeme;
 	}
 
 };
 
 
-static const Token THIS_TOKEN = {IDENTIFIER, "this", {}, 0};
-static const Token NAMESPACE_TOKEN = {IDENTIFIER, "namespace", {}, 0};
+static const Token THIS_TOKEN = {IDENTIFIER, "this", 0};
+static const Token NAMESPACE_TOKEN = {IDENTIFIER, "namespace", 0};
 
 }
@@ -0,0 +1,192 @@
+#include "value.h"
+#include "callable.h"
+#include "class.h"
+#include "object.h"
+#include <array>
+#include <unordered_map>
+
+namespace minik {
+
+Value Value::character(char c) {
+	// per thread like the pools, the reference counts aren't atomic
+	static thread_local std::array<Value, 256> s_characters = [] {
+		std::array<Value, 256> characters;
+		for (size_t i = 0; i < characters.size(); ++i) {
+			HeapBox<String>* cell = new HeapBox<String>(std::string(1, static_cast<char>(i)));
+			cell->data.m_interned = true;
+			characters[i] = Value(STRING, cell);
+		}
+		return characters;
+	}();
+	return s_characters[static_cast<unsigned char>(c)];
+}
+
+Value Value::intern(std::string_view text) {
+	if (text.size() == 1) {
+		return character(text[0]);
+	}
+	// keyed by the text of the cell, which the table keeps alive
+	static thread_local std::unordered_map<std::string_view, Value> s_interned;
+	auto it = s_interned.find(text);
+	if (it != s_interned.end()) {
+		return it->second;
+	}
+	HeapBox<String>* cell = new HeapBox<String>(std::string(text));
+	cell->data.m_interned = true;
+	Value value(STRING, cell);
+	s_interned.emplace(cell->data.text(), value);
+	return value;
+}
+
+// copies of a list share their elements, only their storage is copied
+void Value::unshare_list() const {
+	Ref<ListBuffer>& buffer = data<Ref<ListBuffer>>();
+	List elements;
+	// with room for the push that usually follows
+	elements.reserve(buffer->elements.size() + 1);
+	elements.insert(elements.end(), buffer->elements.begin(), buffer->elements.end());
+	buffer = CreateRef<ListBuffer>(std::move(elements));
+}
+
+void Value::destroy() {
+	HeapCell* c = cell();
+	switch (m_bits & TYPE_MASK) {
+		case STRING:    delete static_cast<HeapBox<String>*>(c); break;
+		// see destroy_cell
+		default:        gc_release(c); break;
+	}
+	m_bits = NIL_BITS;
+}
+
+void Value::trace_cell(const GCHeader* cell, GCTracer& tracer) {
+	switch (cell->gc_kind()) {
+		case GCKind::LIST_CELL:
+			tracer.visit(static_cast<const HeapBox<Ref<ListBuffer>>*>(cell)->data);
+			break;
+		case GCKind::CALLABLE_CELL:
+			tracer.visit(static_cast<const HeapBox<Ref<MinikCallable>>*>(cell)->data);
+			break;
+		case GCKind::INSTANCE_CELL:
+			tracer.visit(static_cast<const HeapBox<Ref<MinikInstance>>*>(cell)->data);
+			break;
+		case GCKind::NAMESPACE_CELL:
+			tracer.visit(static_cast<const HeapBox<Ref<MinikNamespace>>*>(cell)->data);
+			break;
+		case GCKind::LIST_BUFFER:
+			for (const Ref<Object>& element : static_cast<const ListBuffer*>(cell)->elements) {
+				tracer.visit(element);
+			}
+			break;
+		default: break;
+	}
+}
+
+void Value::clear_cell(const GCHeader* cell) {
+	switch (cell->gc_kind()) {
+		case GCKind::LIST_CELL:     const_cast<HeapBox<Ref<ListBuffer>>*>(static_cast<const HeapBox<Ref<ListBuffer>>*>(cell))->data = nullptr; break;
+		case GCKind::CALLABLE_CELL: const_cast<HeapBox<Ref<MinikCallable>>*>(static_cast<const HeapBox<Ref<MinikCallable>>*>(cell))->data = nullptr; break;
+		case GCKind::INSTANCE_CELL: const_cast<HeapBox<Ref<MinikInstance>>*>(static_cast<const HeapBox<Ref<MinikInstance>>*>(cell))->data = nullptr; break;
+		case GCKind::NAMESPACE_CELL: const_cast<HeapBox<Ref<MinikNamespace>>*>(static_cast<const HeapBox<Ref<MinikNamespace>>*>(cell))->data = nullptr; break;
+		case GCKind::LIST_BUFFER:   const_cast<ListBuffer*>(static_cast<const ListBuffer*>(cell))->elements.clear(); break;
+		default: break;
+	}
+}
+
+List Value::take_list(const GCHeader* cell) {
+	const Ref<ListBuffer>& buffer = static_cast<const HeapBox<Ref<ListBuffer>>*>(cell)->data;
+	if (!buffer || buffer->ref_count() > 1) {
+		return {};
+	}
+	return std::move(buffer->elements);
+}
+
+void Value::destroy_cell(const GCHeader* cell) {
+	if (cell->gc_root() != 0) {
+		gc_forget_root(cell);
+	}
+	switch (cell->gc_kind()) {
+		case GCKind::LIST_CELL:     delete static_cast<const HeapBox<Ref<ListBuffer>>*>(cell); break;
+		case GCKind::CALLABLE_CELL: delete static_cast<const HeapBox<Ref<MinikCallable>>*>(cell); break;
+		case GCKind::INSTANCE_CELL: delete static_cast<const HeapBox<Ref<MinikInstance>>*>(cell); break;
+		case GCKind::NAMESPACE_CELL: delete static_cast<const HeapBox<Ref<MinikNamespace>>*>(cell); break;
+		case GCKind::LIST_BUFFER:   delete static_cast<const ListBuffer*>(cell); break;
+		default: break;
+	}
+}
+
+std::string Value::to_string() const {
+	if (is_nil()) {
+		return "nil";
+	} else if (is_bool()) {
+		return as_bool() ? "true" : "false";
+	} else if (is_double()) {
+		return std::to_string(as_double());
+	} else if (is_string()) {
+		return as_string();
+	} else if (is_callable()) {
+		return as_callable()->to_string();
+	} else if (is_instance()) {
+		return as_instance()->to_string();
+	} else if (is_namespace()) {
+		return as_namespace()->to_string();
+	} else if (is_list()) {
+		std::string txt = "<list>";
+		const List& list = as_list();
+		for (size_t i = 0; i < list.size(); ++i) {
+			const Ref<Object>& element = list.at(i);
+			txt += element->to_string();
+			if (i != list.size()-1) {
+				txt += ", ";
+			}
+		}
+
+		txt += "</list size="+std::to_string(list.size())+">";
+		return txt;
+	}
+	return "";
+}
+
+bool Value::to_bool() const {
+	if (is_nil()) {
+		return false;
+	}
+	if (is_bool()) {
+		return as_bool();
+	}
+	if (is_double()) {
+		return (as_double() != 0.0);
+	}
+	if (is_list()) {
+		return as_list().empty();
+	}
+
+	// TODO: throw exception ?
+	// MN_ERROR("Unreachable. Object::to_bool()");
+	return false;
+}
+
+bool Value::equals(const Value& other) const {
+	if (is_nil() && other.is_nil()) {
+		return true;
+	}
+	if (is_bool() && other.is_bool()) {
+		return (as_bool() == other.as_bool());
+	}
+	if (is_double() && other.is_double()) {
+		return (as_double() == other.as_double());
+	}
+	if (is_string() && other.is_string()) {
+		if (cell() == other.cell()) {
+			return true;
+		}
+		const String& a = data<String>();
+		const String& b = other.data<String>();
+		if ((a.is_interned() && b.is_interned()) || a.text().size() != b.text().size() || a.hash() != b.hash()) {
+			return false;
+		}
+		return (a.text() == b.text());
+	}
+	return (to_bool() == other.to_bool());
+}
+
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include "base.h"
+#include "gc.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace minik {
+
+struct Object;
+class MinikCallable;
+class MinikInstance;
+class MinikNamespace;
+
+using List = std::vector<Ref<Object>>;
+
+// elements of a list, shared by the copies of the list until one of them adds or removes one
+class ListBuffer : public CollectableRoot {
+public:
+	ListBuffer(const List& elements) : CollectableRoot(GCKind::LIST_BUFFER), elements(elements) {}
+	ListBuffer(List&& elements) : CollectableRoot(GCKind::LIST_BUFFER), elements(std::move(elements)) {}
+
+	List elements;
+};
+
+// text of a string value, it never changes so every copy of the value shares it.
+// Interned strings are the only string with their text, two of them are equal when they are the same.
+class String {
+public:
+	explicit String(std::string text) : m_text(std::move(text)) {}
+
+	const std::string& text() const { return m_text; }
+	bool is_interned() const { return m_interned; }
+	// computed on first use
+	size_t hash() const {
+		if (m_hash == 0) {
+			m_hash = std::hash<std::string_view>{}(m_text) | 1;
+		}
+		return m_hash;
+	}
+
+private:
+	friend class Value;
+
+	std::string m_text;
+	mutable size_t m_hash = 0;
+	bool m_interned = false;
+};
+
+// 8 byte NaN-boxed value.
+// Doubles are stored as they are, nil and bool live in the payload of a quiet NaN.
+// Strings, lists, callables, instances and namespaces are pointers to a reference
+// counted heap cell, tagged with the sign bit and their type in the low 3 bits.
+// Copying a Value shares the heap cell, use clone() for a copy of a list.
+// Strings are immutable, a changed string is a new value. All one byte strings are preallocated.
+// A copy of a list is a new cell sharing the storage of the elements, the first push, pop
+// or clear through either cell gives it storage of its own.
+class Value {
+public:
+	Value() : m_bits(NIL_BITS) {}
+	Value(std::nullptr_t) : m_bits(NIL_BITS) {}
+	Value(bool val) : m_bits(val ? TRUE_BITS : FALSE_BITS) {}
+	Value(double val) {
+		if (val != val) {
+			m_bits = CANONICAL_NAN;
+		} else {
+			std::memcpy(&m_bits, &val, sizeof(double));
+		}
+	}
+	Value(const std::string& val)              : Value(std::string(val)) {}
+	Value(std::string&& val)                   : Value(val.size() == 1 ? character(val[0]) : Value(STRING, new HeapBox<String>(std::move(val)))) {}
+	Value(const List& val)                     : Value(LIST,      new HeapBox<Ref<ListBuffer>>(CreateRef<ListBuffer>(val))) {}
+	Value(List&& val)                          : Value(LIST,      new HeapBox<Ref<ListBuffer>>(CreateRef<ListBuffer>(std::move(val)))) {}
+	Value(const Ref<MinikCallable>& val)       : Value(CALLABLE,  new HeapBox<Ref<MinikCallable>>(val)) {}
+	Value(const Ref<MinikInstance>& val)       : Value(INSTANCE,  new HeapBox<Ref<MinikInstance>>(val)) {}
+	Value(const Ref<MinikNamespace>& val)      : Value(NAMESPACE, new HeapBox<Ref<MinikNamespace>>(val)) {}
+
+	Value(const Value& other) : m_bits(other.m_bits) { retain(); }
+	Value(Value&& other) noexcept : m_bits(other.m_bits) { other.m_bits = NIL_BITS; }
+	~Value() { release(); }
+
+	// the old value is released last, other may live inside it (value = value[0])
+	Value& operator=(const Value& other) {
+		Value(other).swap(*this);
+		return *this;
+	}
+	Value& operator=(Value&& other) noexcept {
+		Value(std::move(other)).swap(*this);
+		return *this;
+	}
+
+	void swap(Value& other) noexcept {
+		const uint64_t bits = m_bits;
+		m_bits = other.m_bits;
+		other.m_bits = bits;
+	}
+
+	// absence of a value, the result of a function that returned nothing.
+	// only the vm keeps it on its stack, it is never stored in an Object
+	static Value none() { return Value(NONE_BITS, 0); }
+	// the preallocated string of one byte
+	static Value character(char c);
+	// the interned string with this text, for literals that are compared often
+	static Value intern(std::string_view text);
+
+	bool is_nil()       const { return m_bits == NIL_BITS; }
+	bool is_none()      const { return m_bits == NONE_BITS; }
+	bool is_bool()      const { return (m_bits | 1) == TRUE_BITS; }
+	bool is_double()    const { return (m_bits & QNAN) != QNAN; }
+	bool is_heap()      const { return (m_bits & HEAP_MASK) == HEAP_MASK; }
+	bool is_string()    const { return is_heap_of(STRING); }
+	bool is_list()      const { return is_heap_of(LIST); }
+	bool is_callable()  const { return is_heap_of(CALLABLE); }
+	bool is_instance()  const { return is_heap_of(INSTANCE); }
+	bool is_namespace() const { return is_heap_of(NAMESPACE); }
+	// a list, callable or instance, what the cycle collector traverses
+	bool is_collectable() const { return is_heap() && (m_bits & TYPE_MASK) >= LIST && (m_bits & TYPE_MASK) <= INSTANCE; }
+
+	bool as_bool() const { return m_bits == TRUE_BITS; }
+	double as_double() const {
+		double val;
+		std::memcpy(&val, &m_bits, sizeof(double));
+		return val;
+	}
+	const std::string& as_string() const { return data<String>().text(); }
+	const List&  as_list()   const { return data<Ref<ListBuffer>>()->elements; }
+	const Ref<MinikCallable>&  as_callable()  const { return data<Ref<MinikCallable>>(); }
+	const Ref<MinikInstance>&  as_instance()  const { return data<Ref<MinikInstance>>(); }
+	const Ref<MinikNamespace>& as_namespace() const { return data<Ref<MinikNamespace>>(); }
+
+	// the elements of a list to add to or remove from, copied first when other lists share them
+	List& mutable_list() const {
+		Ref<ListBuffer>& buffer = data<Ref<ListBuffer>>();
+		if (buffer->ref_count() > 1) {
+			unshare_list();
+		}
+		return buffer->elements;
+	}
+
+	// lists are copied, everything else is shared
+	Value clone() const {
+		if (is_list()) {
+			return Value(LIST, new HeapBox<Ref<ListBuffer>>(data<Ref<ListBuffer>>()));
+		}
+		return *this;
+	}
+
+	std::string to_string() const;
+	bool to_bool() const;
+	bool equals(const Value& other) const;
+
+	// heap cell the cycle collector traverses, null for strings and immediates
+	const GCHeader* gc_cell() const {
+		return (is_heap() && cell()->gc_kind() != GCKind::NONE) ? cell() : nullptr;
+	}
+	static void trace_cell(const GCHeader* cell, GCTracer& tracer);
+	static void clear_cell(const GCHeader* cell);
+	static void destroy_cell(const GCHeader* cell);
+	// the elements of a list cell no other list shares, moved out so a large list can be released in steps
+	static List take_list(const GCHeader* cell);
+
+private:
+	enum HeapType : uint64_t { STRING = 1, LIST, CALLABLE, INSTANCE, NAMESPACE };
+
+	struct HeapCell : public GCHeader {
+		HeapCell(GCKind kind) : GCHeader(kind) { m_ref_count = 1; }
+	};
+	template<typename T>
+	struct HeapBox : HeapCell {
+		template<typename U>
+		HeapBox(U&& val) : HeapCell(cell_kind()), data(std::forward<U>(val)) {}
+		T data;
+
+		static constexpr GCKind cell_kind() {
+			if constexpr (std::is_same_v<T, Ref<ListBuffer>>) {
+				return GCKind::LIST_CELL;
+			} else if constexpr (std::is_same_v<T, Ref<MinikCallable>>) {
+				return GCKind::CALLABLE_CELL;
+			} else if constexpr (std::is_same_v<T, Ref<MinikInstance>>) {
+				return GCKind::INSTANCE_CELL;
+			} else if constexpr (std::is_same_v<T, Ref<MinikNamespace>>) {
+				return GCKind::NAMESPACE_CELL;
+			}
+			return GCKind::NONE;
+		}
+	};
+
+	static constexpr uint64_t SIGN_BIT      = 0x8000000000000000;
+	static constexpr uint64_t QNAN          = 0x7ffc000000000000;
+	static constexpr uint64_t HEAP_MASK     = SIGN_BIT | QNAN;
+	static constexpr uint64_t POINTER_MASK  = 0x0000fffffffffff8;
+	static constexpr uint64_t TYPE_MASK     = 0x7;
+	static constexpr uint64_t CANONICAL_NAN = 0x7ff8000000000000;
+	static constexpr uint64_t NIL_BITS      = QNAN | 1;
+	static constexpr uint64_t NONE_BITS     = QNAN | 4;
+	static constexpr uint64_t FALSE_BITS    = QNAN | 2;
+	static constexpr uint64_t TRUE_BITS     = QNAN | 3;
+
+	Value(uint64_t bits, int) : m_bits(bits) {}
+	Value(HeapType type, HeapCell* cell) : m_bits(HEAP_MASK | reinterpret_cast<uint64_t>(cell) | type) {}
+
+	bool is_heap_of(HeapType type) const { return (m_bits & (HEAP_MASK | TYPE_MASK)) == (HEAP_MASK | type); }
+	HeapCell* cell() const { return reinterpret_cast<HeapCell*>(m_bits & POINTER_MASK); }
+
+	template<typename T>
+	T& data() const { return static_cast<HeapBox<T>*>(cell())->data; }
+
+	void retain() const {
+		if (is_heap()) {
+			cell()->m_ref_count++;
+		}
+	}
+	void release() {
+		if (is_heap()) {
+			HeapCell* c = cell();
+			if (--c->m_ref_count == 0) {
+				destroy();
+			} else if (c->gc_root() == 0 && c->gc_kind() != GCKind::NONE) {
+				gc_possible_root(c);
+			}
+		}
+	}
+	void destroy();
+	void unshare_list() const;
+
+private:
+	uint64_t m_bits;
+};
+
+}
@@ -0,0 +1,731 @@
+#include "vm.h"
+#include "base.h"
+#include "class.h"
+#include "compiler.h"
+#include "environment.h"
+#include "exception.h"
+#include "function.h"
+#include "interpreter.h"
+#include "object.h"
+#include "token.h"
+
+namespace minik {
+
+static constexpr size_t STACK_MAX  = 1 << 16;
+static constexpr size_t FRAMES_MAX = 1 << 12;
+
+
+const Chunk* VM::compile(MinikFunction& function) {
+	if (function.m_compiled) {
+		return function.m_chunk;
+	}
+
+	const BlockStatement* body = function.m_declaration.body.get();
+
+	auto it = m_chunks.find(body);
+	if (it == m_chunks.end()) {
+		Compiler compiler = Compiler(m_interpreter);
+		it = m_chunks.emplace(body, compiler.compile(function.m_declaration)).first;
+	}
+
+	function.m_chunk = it->second.get();
+	function.m_compiled = true;
+	return function.m_chunk;
+}
+
+const Chunk* VM::compile_callee(MinikCallable& callee) {
+	MinikFunction* function = dynamic_cast<MinikFunction*>(&callee);
+	return (function && !function->m_callable) ? compile(*function) : nullptr;
+}
+
+Ref<Object> VM::call(MinikFunction& function, const Chunk& chunk, const Arguments& arguments, const Ref<Object>& self) {
+	const size_t base = begin_call();
+	for (size_t i = 0; i < chunk.arity && i < arguments.size(); ++i) {
+		push_argument(function.m_declaration.name, from_object(arguments[i]));
+	}
+	return to_object(call(function, chunk, base, self));
+}
+
+bool VM::run_loop(const ForStatement& loop, const Ref<Environment>& environment) {
+	auto it = m_loops.find(&loop);
+	if (it == m_loops.end()) {
+		Compiler compiler = Compiler(m_interpreter);
+		it = m_loops.emplace(&loop, compiler.compile(loop)).first;
+	}
+	if (!it->second) {
+		return false;
+	}
+
+	// the frame needs a function, its closure is the environment the loop runs in.
+	// It doesn't outlive the loop, so the environment isn't kept as a closure
+	static const FunctionStatement declaration(Token(IDENTIFIER, "loop", 0), {}, nullptr);
+	Ref<MinikFunction> function = CreateRef<MinikFunction>(declaration, nullptr);
+	function->m_closure = environment;
+
+	call(*function, *it->second, begin_call(), nullptr);
+	return true;
+}
+
+size_t VM::begin_call() {
+	if (m_stack.empty()) {
+		m_stack.resize(STACK_MAX);
+		m_frames.reserve(FRAMES_MAX);
+	}
+	return m_top;
+}
+
+void VM::push_argument(const Token& paren, Value value) {
+	if (m_top >= STACK_MAX) {
+		throw InterpreterException(paren, "Stack overflow.");
+	}
+	m_stack[m_top++] = std::move(value);
+}
+
+Value VM::call(MinikFunction& function, const Chunk& chunk, size_t base, const Ref<Object>& self) {
+	const size_t entry_frame = m_frames.size();
+	try {
+		push_frame(function, chunk, base, base, function.m_declaration.name);
+		if (function.m_declaration.is_method) {
+			// a bound method is called with the instance it was bound to
+			m_stack[base + chunk.arity] = from_object(self ? self : function.m_this);
+		}
+		return run(entry_frame);
+	} catch (...) {
+		release(base);
+		m_frames.resize(entry_frame);
+		throw;
+	}
+}
+
+void VM::push_frame(MinikFunction& function, const Chunk& chunk, size_t base, size_t return_top, const Token& token) {
+	if (m_frames.size() >= FRAMES_MAX || base + chunk.slot_count + chunk.max_stack >= STACK_MAX) {
+		throw InterpreterException(token, "Stack overflow.");
+	}
+
+	for (size_t i = base + chunk.arity; i < base + chunk.slot_count; ++i) {
+		m_stack[i] = Value();
+	}
+	m_top = base + chunk.slot_count;
+	m_frames.push_back(CallFrame{&chunk, 0, base, return_top, &function});
+}
+
+void VM::release(size_t from) {
+	for (size_t i = from; i < m_top; ++i) {
+		m_stack[i] = Value();
+	}
+	m_top = from;
+}
+
+
+#define TOP(n) m_stack[m_top - 1 - (n)]
+#define POP() m_stack[--m_top] = Value()
+#define TOKEN() chunk->tokens[in.token]
+
+#define NUMERIC_OPERANDS()                                                                                        \
+	Value& l = TOP(1);                                                                                            \
+	const Value& r = TOP(0);                                                                                      \
+	if (!l.is_double()) {                                                                                         \
+		throw InterpreterException(TOKEN(), Object(l), "Invalid operand to binary expression.");                  \
+	}                                                                                                             \
+	if (!r.is_double()) {                                                                                         \
+		throw InterpreterException(TOKEN(), Object(r), "Invalid operand to binary expression.");                  \
+	}                                                                                                             \
+	const double a = l.as_double();                                                                               \
+	const double b = r.as_double();                                                                               \
+	m_top--;
+
+Value VM::run(size_t entry_frame) {
+	CallFrame* frame = &m_frames.back();
+	const Chunk* chunk = frame->chunk;
+	const Instruction* code = chunk->code.data();
+	Value* slots = &m_stack[frame->base];
+	size_t ip = frame->ip;
+
+	for (;;) {
+		const Instruction& in = code[ip++];
+
+		switch (in.op) {
+			case OpCode::CONSTANT: {
+				const Value& constant = chunk->constants[in.operand];
+				if (in.flags & OP_FLAG_COPY) {
+					m_stack[m_top++] = constant.clone();
+				} else {
+					m_stack[m_top++] = constant;
+				}
+				break;
+			}
+			case OpCode::NIL:   m_stack[m_top++] = Value(); break;
+			case OpCode::NONE:  m_stack[m_top++] = Value::none(); break;
+			case OpCode::TRUE:  m_stack[m_top++] = Value(true); break;
+			case OpCode::FALSE: m_stack[m_top++] = Value(false); break;
+			case OpCode::POP:   POP(); break;
+
+			case OpCode::GET_LOCAL:
+				m_stack[m_top++] = slots[in.operand];
+				break;
+			case OpCode::SET_LOCAL:
+				if (in.flags & OP_FLAG_COPY) {
+					slots[in.operand] = TOP(0).clone();
+				} else {
+					slots[in.operand] = TOP(0);
+				}
+				break;
+			case OpCode::INC_LOCAL: {
+				Value& slot = slots[in.operand];
+				if (!slot.is_double()) {
+					throw InterpreterException(TOKEN(), Object(slot), "Invalid argument type to unary expression.");
+				}
+				slot = slot.as_double() + (in.depth ? 1.0 : -1.0);
+				m_stack[m_top++] = slot;
+				break;
+			}
+
+			case OpCode::GET_CAPTURE: {
+				if ((in.flags & OP_FLAG_NAMESPACE) && probe_namespace(*frame, in, in.token, m_stack[m_top])) {
+					m_top++;
+					break;
+				}
+				m_stack[m_top++] = from_object(frame->function->m_captures[in.operand]);
+				break;
+			}
+			case OpCode::SET_CAPTURE:
+				store(frame->function->m_captures[in.operand], TOP(0));
+				break;
+			case OpCode::INC_CAPTURE:
+				m_stack[m_top++] = increment(TOKEN(), frame->function->m_captures[in.operand], in.depth ? 1 : -1);
+				break;
+
+			case OpCode::GET_UPPER: {
+				if ((in.flags & OP_FLAG_NAMESPACE) && probe_namespace(*frame, in, chunk->uppers[in.operand].name, m_stack[m_top])) {
+					m_top++;
+					break;
+				}
+				m_stack[m_top++] = from_object(get_upper(*frame, in));
+				break;
+			}
+			case OpCode::SET_UPPER:
+				store(get_upper(*frame, in), TOP(0));
+				break;
+			case OpCode::INC_UPPER:
+				m_stack[m_top++] = increment(TOKEN(), get_upper(*frame, in), in.depth ? 1 : -1);
+				break;
+
+			case OpCode::GET_GLOBAL: {
+				if ((in.flags & OP_FLAG_NAMESPACE) && probe_namespace(*frame, in, chunk->globals[in.operand].name, m_stack[m_top])) {
+					m_top++;
+					break;
+				}
+				m_stack[m_top++] = from_object(get_global(*frame, in));
+				break;
+			}
+			case OpCode::SET_GLOBAL:
+				store(get_global(*frame, in), TOP(0));
+				break;
+			case OpCode::INC_GLOBAL:
+				m_stack[m_top++] = increment(TOKEN(), get_global(*frame, in), in.depth ? 1 : -1);
+				break;
+
+			case OpCode::GET_PROPERTY:
+				TOP(0) = get_property(chunk->tokens[in.operand], TOP(0), chunk->fields[in.depth]);
+				break;
+			case OpCode::SET_PROPERTY:
+				set_property(chunk->tokens[in.operand], TOP(1), TOP(0), chunk->fields[in.depth]);
+				TOP(1) = std::move(TOP(0));
+				m_top--;
+				break;
+			case OpCode::INC_PROPERTY:
+				TOP(0) = increment(TOKEN(), property_cell(chunk->tokens[in.operand], TOP(0)), in.depth ? 1 : -1);
+				break;
+
+			case OpCode::GET_INDEX: {
+				Value result = get_index(TOKEN(), TOP(1), TOP(0));
+				POP();
+				TOP(0) = std::move(result);
+				break;
+			}
+			case OpCode::SET_INDEX: {
+				if (in.flags & (OP_FLAG_FIELD | OP_FLAG_ELEMENT)) {
+					// the string is read from the cell it is stored back to
+					Ref<Object> cell = (in.flags & OP_FLAG_FIELD)
+						? property_cell(chunk->tokens[in.operand], TOP(2))
+						: element_cell(chunk->tokens[in.operand], TOP(3), TOP(2));
+					Value result = set_index(TOKEN(), from_object(cell), TOP(1), TOP(0));
+					if (result.is_string()) {
+						cell->value = result;
+					}
+					if (in.flags & OP_FLAG_ELEMENT) {
+						POP();
+					}
+					POP();
+					POP();
+					TOP(0) = std::move(result);
+					break;
+				}
+				Value result = set_index(TOKEN(), TOP(2), TOP(1), TOP(0));
+				POP();
+				POP();
+				TOP(0) = std::move(result);
+				if ((in.flags & OP_FLAG_STORE) && !TOP(0).is_string()) {
+					ip++;
+				}
+				break;
+			}
+			case OpCode::INC_INDEX: {
+				// list elements are incremented in place
+				Ref<Object> cell = element_cell(chunk->tokens[in.operand], TOP(1), TOP(0));
+				Value result = increment(TOKEN(), cell, in.depth ? 1 : -1);
+				POP();
+				TOP(0) = std::move(result);
+				break;
+			}
+			case OpCode::INC_VALUE: {
+				Value& value = TOP(0);
+				if (!value.is_double()) {
+					throw InterpreterException(TOKEN(), Object(value), "Invalid argument type to unary expression.");
+				}
+				value = value.as_double() + (in.depth ? 1.0 : -1.0);
+				break;
+			}
+
+			case OpCode::ADD: {
+				if (TOP(1).is_string() && TOP(0).is_string()) {
+					Value result = Value(TOP(1).as_string() + TOP(0).as_string());
+					POP();
+					TOP(0) = std::move(result);
+					break;
+				}
+				NUMERIC_OPERANDS();
+				l = a + b;
+				break;
+			}
+			case OpCode::SUBTRACT:      { NUMERIC_OPERANDS(); l = a - b; break; }
+			case OpCode::MULTIPLY:      { NUMERIC_OPERANDS(); l = a * b; break; }
+			case OpCode::DIVIDE:        { NUMERIC_OPERANDS(); l = a / b; break; }
+			case OpCode::MODULO:        { NUMERIC_OPERANDS(); l = double(int(a) % int(b)); break; }
+			case OpCode::GREATER:       { NUMERIC_OPERANDS(); l = a >  b; break; }
+			case OpCode::GREATER_EQUAL: { NUMERIC_OPERANDS(); l = a >= b; break; }
+			case OpCode::LESS:          { NUMERIC_OPERANDS(); l = a <  b; break; }
+			case OpCode::LESS_EQUAL:    { NUMERIC_OPERANDS(); l = a <= b; break; }
+
+			case OpCode::EQUAL:
+			case OpCode::NOT_EQUAL: {
+				bool equal = is_equal(TOKEN(), TOP(1), TOP(0));
+				POP();
+				TOP(0) = in.op == OpCode::EQUAL ? equal : !equal;
+				break;
+			}
+
+			case OpCode::NOT:
+				TOP(0) = !is_truthy(TOKEN(), TOP(0));
+				break;
+			case OpCode::NEGATE: {
+				Value& value = TOP(0);
+				if (!value.is_double()) {
+					throw InterpreterException(TOKEN(), Object(value), "Invalid argument type to unary expression.");
+				}
+				value = -value.as_double();
+				break;
+			}
+
+			case OpCode::JUMP:
+				if ((size_t)in.operand < ip) {
+					// loop back edge
+					CycleCollector::safe_point();
+				}
+				ip = in.operand;
+				break;
+			case OpCode::JUMP_IF_FALSE: {
+				bool truthy = is_truthy(TOP(0));
+				POP();
+				if (!truthy) {
+					ip = in.operand;
+				}
+				break;
+			}
+			case OpCode::JUMP_IF_TRUE_KEEP:
+				if (is_truthy(TOP(0))) {
+					ip = in.operand;
+				} else {
+					POP();
+				}
+				break;
+			case OpCode::JUMP_IF_FALSE_KEEP:
+				if (!is_truthy(TOP(0))) {
+					ip = in.operand;
+				} else {
+					POP();
+				}
+				break;
+
+			case OpCode::CALL:
+			case OpCode::INVOKE: {
+				frame->ip = ip;
+				const size_t frames = m_frames.size();
+				if (in.op == OpCode::CALL) {
+					call_value(in.operand, TOKEN(), chunk->calls[in.depth]);
+				} else {
+					invoke(in.operand, TOKEN(), chunk->invokes[in.depth]);
+				}
+				if (m_frames.size() != frames) {
+					frame = &m_frames.back();
+					chunk = frame->chunk;
+					code = chunk->code.data();
+					slots = &m_stack[frame->base];
+					ip = 0;
+				}
+				break;
+			}
+
+			case OpCode::RETURN: {
+				Value result = std::move(TOP(0));
+				m_top--;
+				if (frame->function->m_is_initializer) {
+					// the instance in the slot after the parameters
+					result = slots[chunk->arity];
+				}
+
+				release(frame->return_top);
+				m_frames.pop_back();
+				if (m_frames.size() == entry_frame) {
+					return result;
+				}
+
+				m_stack[m_top++] = std::move(result);
+				frame = &m_frames.back();
+				chunk = frame->chunk;
+				code = chunk->code.data();
+				slots = &m_stack[frame->base];
+				ip = frame->ip;
+				break;
+			}
+
+			case OpCode::LIST: {
+				List list = {};
+				list.reserve(in.operand);
+				for (size_t i = m_top - in.operand; i < m_top; ++i) {
+					list.push_back(copy(m_stack[i]));
+				}
+				release(m_top - in.operand);
+				m_stack[m_top++] = Value(std::move(list));
+				break;
+			}
+			case OpCode::LIST_SIZED: {
+				const Value& size_value = TOP(0);
+				if (!size_value.is_double()) {
+					throw InterpreterException(TOKEN(), "Array size must be a number.");
+				}
+				size_t size = size_value.as_double();
+				List list = {};
+				list.reserve(size);
+				for (size_t i = 0; i < size; ++i) {
+					list.push_back(CreateRef<Object>(0.0));
+				}
+				TOP(0) = Value(std::move(list));
+				break;
+			}
+		}
+	}
+}
+
+#undef NUMERIC_OPERANDS
+#undef TOKEN
+#undef POP
+#undef TOP
+
+
+void VM::call_value(size_t argc, const Token& paren, const CallCache& cache) {
+	const size_t callee_index = m_top - argc - 1;
+	const Value& callee = m_stack[callee_index];
+
+	if (callee.is_none()) {
+		throw InterpreterException(paren, "Callee is null.");
+	}
+	if (!callee.is_callable()) {
+		throw InterpreterException(paren, "Object is not callable.");
+	}
+	check_arguments(argc, paren);
+
+	const Ref<MinikCallable>& function = callee.as_callable();
+
+	if (function->id() != cache.callee) {
+		if (function->arity() != -1 && (int)argc != function->arity()) {
+			throw InterpreterException(paren, "Expected " +
+							 std::to_string(function->arity()) + " arguments but got " +
+							 std::to_string(argc) + ".");
+		}
+		MinikFunction* minik_function = dynamic_cast<MinikFunction*>(function.get());
+		cache.callee = function->id();
+		cache.function = (minik_function && !minik_function->m_callable) ? minik_function : nullptr;
+		cache.chunk = cache.function ? compile(*cache.function) : nullptr;
+	}
+
+	if (cache.chunk) {
+		push_call(*cache.function, *cache.chunk, callee_index, paren, from_object(cache.function->m_this));
+		return;
+	}
+
+	call_tree(*function, callee_index, paren, nullptr);
+}
+
+// obj.method(), the method is called with the instance in its 'this' slot instead of being bound
+void VM::invoke(size_t argc, const Token& paren, const InvokeCache& cache) {
+	const size_t callee_index = m_top - argc - 1;
+	Value& object = m_stack[callee_index];
+	const Token& name = m_frames.back().chunk->tokens[cache.name];
+
+	if (object.is_instance()) {
+		Ref<MinikFunction> method = object.as_instance()->find_method(name.lexeme, cache.field, cache.method);
+		if (method) {
+			check_arguments(argc, paren);
+			if (method->id() != cache.call.callee) {
+				if ((int)argc != method->arity()) {
+					throw InterpreterException(paren, "Expected " +
+									 std::to_string(method->arity()) + " arguments but got " +
+									 std::to_string(argc) + ".");
+				}
+				cache.call.callee = method->id();
+				cache.call.function = method.get();
+				cache.call.chunk = compile(*method);
+			}
+
+			if (cache.call.chunk) {
+				Value self = object;
+				push_call(*method, *cache.call.chunk, callee_index, paren, std::move(self));
+				return;
+			}
+			call_tree(*method, callee_index, paren, CreateRef<Object>(object.as_instance()));
+			return;
+		}
+	}
+
+	// a field holding a callable or a method of a native class
+	object = get_property(name, object, cache.field);
+	call_value(argc, paren, cache.call);
+}
+
+void VM::check_arguments(size_t argc, const Token& paren) const {
+	for (size_t i = m_top - argc; i < m_top; ++i) {
+		if (m_stack[i].is_none()) {
+			throw InterpreterException(paren, "Object is not callable.");
+		}
+	}
+}
+
+void VM::push_call(MinikFunction& function, const Chunk& chunk, size_t callee_index, const Token& paren, Value self) {
+	// arguments are shared, strings are immutable and lists are passed by reference
+	push_frame(function, chunk, callee_index + 1, callee_index, paren);
+	if (function.m_declaration.is_method) {
+		// the slot after the parameters
+		m_stack[callee_index + 1 + chunk.arity] = std::move(self);
+	}
+}
+
+// calls a native function or a body the vm can't run
+void VM::call_tree(MinikCallable& function, size_t callee_index, const Token& paren, const Ref<Object>& self) {
+	Arguments& arguments = m_interpreter.acquire_arguments();
+	for (size_t i = callee_index + 1; i < m_top; ++i) {
+		arguments.emplace_back(to_argument(m_stack[i]));
+	}
+
+	Ref<Object> result;
+	try {
+		if (self) {
+			result = static_cast<MinikFunction&>(function).invoke(m_interpreter, arguments, self);
+		} else {
+			result = function.call(m_interpreter, arguments);
+		}
+	} catch (AssertException) {
+		m_interpreter.release_arguments();
+		throw InterpreterException(paren, "Assertion failed.");
+	} catch (...) {
+		m_interpreter.release_arguments();
+		throw;
+	}
+	m_interpreter.release_arguments();
+
+	release(callee_index);
+	m_stack[m_top++] = from_object(result);
+}
+
+
+Ref<Object> VM::get_upper(const CallFrame& frame, const Instruction& in) const {
+	std::vector<Ref<Object>>& cells = frame.function->m_uppers;
+	if (cells.empty()) {
+		cells.resize(frame.chunk->uppers.size());
+	}
+	Ref<Object>& cell = cells[in.operand];
+	if (!cell) {
+		const Upper& upper = frame.chunk->uppers[in.operand];
+		cell = upper.slot >= 0
+			? frame.function->m_closure->capture(upper.depth, upper.slot)
+			: frame.function->m_closure->get_at(upper.depth, frame.chunk->tokens[upper.name]);
+	}
+	return cell;
+}
+
+Ref<Object> VM::get_global(const CallFrame& frame, const Instruction& in) const {
+	const GlobalCache& global = frame.chunk->globals[in.operand];
+	return m_interpreter.m_globals->get_global(global.index, frame.chunk->tokens[global.name]);
+}
+
+bool VM::probe_namespace(const CallFrame& frame, const Instruction& in, int32_t name, Value& out) const {
+	const Ref<Object>& ns = frame.function->m_namespace;
+	if (!ns || !ns->is_namespace()) {
+		return false;
+	}
+	Ref<Object> result = ns->as_namespace()->get(frame.chunk->tokens[name]);
+	if (!result) {
+		return false;
+	}
+	out = from_object(result);
+	return true;
+}
+
+
+Value VM::get_property(const Token& name, const Value& object, const FieldCache& cache) const {
+	return from_object(property_cell(name, object, cache));
+}
+
+void VM::set_property(const Token& name, const Value& object, const Value& value, const FieldCache& cache) const {
+	if (object.is_instance()) {
+		object.as_instance()->set(name, copy(value), cache);
+		return;
+	}
+	if (object.is_namespace()) {
+		store(object.as_namespace()->get(name), value);
+		return;
+	}
+
+	throw InterpreterException(name, "Attempted to access property of a non-instance object.");
+}
+
+Ref<Object> VM::property_cell(const Token& name, const Value& object, const FieldCache& cache) const {
+	if (object.is_instance()) {
+		const Ref<MinikInstance>& instance = object.as_instance();
+		return instance->get(name, instance, cache);
+	}
+	if (object.is_namespace()) {
+		return object.as_namespace()->get(name);
+	}
+
+	throw InterpreterException(name, "Attempted to access property of a non-instance object." + name.lexeme + object.to_string());
+}
+
+Value VM::get_index(const Token& token, const Value& object, const Value& key) const {
+	if (!key.is_double()) {
+		throw InterpreterException(token, "List indices must be of type double.");
+	}
+	const double index = key.as_double();
+
+	if (object.is_list()) {
+		const List& list = object.as_list();
+		if (index < 0 || index >= list.size()) {
+			throw InterpreterException(token, "List index out of bounds. The index " + std::to_string(index) + " is outside the valid range of 0 to " + std::to_string(list.size() - 1) + ".");
+		}
+		return from_object(list.at(static_cast<size_t>(index)));
+	} else if (object.is_string()) {
+		const std::string& str = object.as_string();
+		if (index < 0 || index >= str.size()) {
+			throw InterpreterException(token, "String index out of bounds. The index " + std::to_string(index) + " is outside the valid range of 0 to " + std::to_string(str.size() - 1) + ".");
+		}
+		return Value::character(str[static_cast<size_t>(index)]);
+	}
+
+	throw InterpreterException(token, "Attempted to index a non-list or non-string type.");
+}
+
+// the element of a list, a copy of the character of a string
+Ref<Object> VM::element_cell(const Token& token, const Value& object, const Value& key) const {
+	// get_index does the checks
+	Value element = get_index(token, object, key);
+	return object.is_list() ? object.as_list().at(static_cast<size_t>(key.as_double())) : to_object(element);
+}
+
+// the list, or the changed copy of the string
+Value VM::set_index(const Token& token, const Value& object, const Value& key, const Value& value) const {
+	if (!key.is_double()) {
+		throw InterpreterException(token, "List indices must be of type double.");
+	}
+	if (key.as_double() < 0) {
+		throw InterpreterException(token, "List index '"+std::to_string(key.as_double())+"' is out of bounds.");
+	}
+	const size_t idx = static_cast<size_t>(key.as_double());
+
+	if (object.is_list()) {
+		const List& list = object.as_list();
+		if (idx >= list.size()) {
+			throw InterpreterException(token, "String index out of bounds. The index " + std::to_string(idx) + " is outside the valid range of 0 to " + std::to_string(list.size() - 1) + ".");
+		}
+		store(list.at(idx), value);
+		return object;
+	}
+
+	if (object.is_string()) {
+		std::string str = value.to_string();
+		if (str.size() > 0) {
+			std::string text = object.as_string();
+			text.at(idx) = str.at(0);
+			return Value(std::move(text));
+		}
+	}
+
+	throw InterpreterException(token, "Attempted to index a non-list or non-string type.");
+}
+
+
+Value VM::from_object(const Ref<Object>& object) {
+	return object ? object->value : Value::none();
+}
+
+Ref<Object> VM::to_object(const Value& value) {
+	return value.is_none() ? nullptr : CreateRef<Object>(value);
+}
+
+Ref<Object> VM::copy(const Value& value) {
+	return value.is_none() ? nullptr : CreateRef<Object>(value.clone());
+}
+
+Ref<Object> VM::to_argument(const Value& value) {
+	return value.is_list() ? to_object(value) : copy(value);
+}
+
+void VM::store(const Ref<Object>& cell, const Value& value) {
+	if (cell) {
+		cell->value = value.is_none() ? Value() : value.clone();
+	}
+}
+
+
+bool VM::is_truthy(const Value& value) {
+	if (value.is_bool()) {
+		return value.as_bool();
+	}
+	if (value.is_double()) {
+		return value.as_double() != 0.0;
+	}
+	return false;
+}
+
+bool VM::is_truthy(const Token& token, const Value& value) const {
+	if (value.is_heap() || value.is_none()) {
+		throw InterpreterException(token, Object(value), "No viable conversion to bool.");
+	}
+	return is_truthy(value);
+}
+
+bool VM::is_equal(const Token& token, const Value& a, const Value& b) const {
+	if (a.is_string() != b.is_string()) {
+		throw InterpreterException(token, Object(a.is_string() ? a : b), "Cannot compare a string with a non-string type.");
+	}
+	return a.equals(b);
+}
+
+Value VM::increment(const Token& token, const Ref<Object>& cell, int delta) const {
+	if (!cell || !cell->is_double()) {
+		throw InterpreterException(token, cell ? *cell : Object(), "Invalid argument type to unary expression.");
+	}
+	cell->value = cell->as_double() + delta;
+	return cell->value;
+}
+
+}
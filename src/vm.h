@@ -0,0 +1,91 @@
+#pragma once
+
+#include "chunk.h"
+#include "callable.h"
+#include <unordered_map>
+#include <vector>
+
+namespace minik {
+
+class Interpreter;
+class Environment;
+class MinikFunction;
+class BlockStatement;
+struct ForStatement;
+
+// Stack based virtual machine that runs the function bodies the Compiler supports,
+// and the loops the tree walker reaches outside of them.
+// Calls between compiled functions stay inside one run loop,
+// everything else goes through MinikCallable::call.
+class VM {
+public:
+	VM(Interpreter& interpreter) : m_interpreter(interpreter) {}
+
+	const Chunk* compile(MinikFunction& function);
+	// the chunk of a function the vm runs, null for natives and bodies it can't compile
+	const Chunk* compile_callee(MinikCallable& callee);
+	Ref<Object> call(MinikFunction& function, const Chunk& chunk, const Arguments& arguments, const Ref<Object>& self = nullptr);
+	// false when the loop can't be compiled and is left to the tree walker
+	bool run_loop(const ForStatement& loop, const Ref<Environment>& environment);
+
+	// calls made by the tree walker, which pushes the argument values straight into the slots
+	// from begin_call(), and drops them with abort_call() if evaluating one of them throws
+	size_t begin_call();
+	void push_argument(const Token& paren, Value value);
+	Value call(MinikFunction& function, const Chunk& chunk, size_t base, const Ref<Object>& self);
+	void abort_call(size_t base) { release(base); }
+
+private:
+	struct CallFrame {
+		const Chunk* chunk;
+		size_t ip;
+		size_t base;
+		size_t return_top;
+		MinikFunction* function;
+	};
+
+	Value run(size_t entry_frame);
+	void push_frame(MinikFunction& function, const Chunk& chunk, size_t base, size_t return_top, const Token& token);
+	void release(size_t from);
+
+	Ref<Object> get_upper(const CallFrame& frame, const Instruction& in) const;
+	Ref<Object> get_global(const CallFrame& frame, const Instruction& in) const;
+	bool probe_namespace(const CallFrame& frame, const Instruction& in, int32_t name, Value& out) const;
+
+	void call_value(size_t argc, const Token& paren, const CallCache& cache);
+	void invoke(size_t argc, const Token& paren, const InvokeCache& cache);
+	void check_arguments(size_t argc, const Token& paren) const;
+	void push_call(MinikFunction& function, const Chunk& chunk, size_t callee_index, const Token& paren, Value self);
+	void call_tree(MinikCallable& function, size_t callee_index, const Token& paren, const Ref<Object>& self);
+	Value get_property(const Token& name, const Value& object, const FieldCache& cache) const;
+	void set_property(const Token& name, const Value& object, const Value& value, const FieldCache& cache) const;
+	Ref<Object> property_cell(const Token& name, const Value& object, const FieldCache& cache = {}) const;
+	Value get_index(const Token& token, const Value& object, const Value& key) const;
+	Ref<Object> element_cell(const Token& token, const Value& object, const Value& key) const;
+	Value set_index(const Token& token, const Value& object, const Value& key, const Value& value) const;
+
+	static Value from_object(const Ref<Object>& object);
+	static Ref<Object> to_object(const Value& value);
+	static Ref<Object> copy(const Value& value);
+	static Ref<Object> to_argument(const Value& value);
+	static void store(const Ref<Object>& cell, const Value& value);
+
+	static bool is_truthy(const Value& value);
+	bool is_truthy(const Token& token, const Value& value) const;
+	bool is_equal(const Token& token, const Value& a, const Value& b) const;
+	Value increment(const Token& token, const Ref<Object>& cell, int delta) const;
+
+private:
+	Interpreter& m_interpreter;
+
+	// compiled chunks by function body
+	std::unordered_map<const BlockStatement*, Ref<Chunk>> m_chunks;
+	// compiled loops of the tree walker
+	std::unordered_map<const ForStatement*, Ref<Chunk>> m_loops;
+
+	std::vector<Value> m_stack;
+	size_t m_top = 0;
+	std::vector<CallFrame> m_frames;
+};
+
+}